@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdint.h>
+
+#include "invert.h"
+
+#ifdef TEST
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#endif /* TEST */
+
+void case_invert_bytes(uint8_t *out, const uint8_t *in, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (in[i] >= 'a' && in[i] <= 'z')
+			out[i] = in[i] - 0x20;
+		else if (in[i] >= 'A' && in[i] <= 'Z')
+			out[i] = in[i] + 0x20;
+		else
+			out[i] = in[i];
+	}
+}
+
+/* Words of the byte buffers, which gcc mustn't assume don't alias bytes */
+typedef uint32_t word_t __attribute__ ((may_alias));
+
+/* A word which may be at any alignment, which gcc loads with lwl/lwr */
+struct unaligned_word {
+	word_t w;
+} __attribute__ ((packed));
+
+#ifdef __mips_dsp
+typedef signed char v4i8 __attribute__ ((vector_size (4)));
+
+/*
+ * Case invert 4 bytes with DSP ASE quad byte operations. Folding a letter
+ * to upper case puts it in 'A'..'Z', so two unsigned byte comparisons pick
+ * 0x20 to flip for letters and 0 for anything else.
+ */
+static inline uint32_t invert_word(uint32_t w)
+{
+	v4i8 x = (v4i8)(w & 0xdfdfdfdf);
+	v4i8 flip;
+
+	__builtin_mips_cmpu_lt_qb(x, (v4i8)0x41414141);		/* x < 'A' */
+	flip = __builtin_mips_pick_qb((v4i8)0, (v4i8)0x20202020);
+	__builtin_mips_cmpu_lt_qb((v4i8)0x5a5a5a5a, x);		/* x > 'Z' */
+	flip = __builtin_mips_pick_qb((v4i8)0, flip);
+
+	return w ^ (uint32_t)flip;
+}
+#else
+/*
+ * Case invert 4 bytes with 32 bit arithmetic (SWAR). Folding a letter to
+ * upper case (clearing 0x20) puts it in 'A'..'Z'. Adding to the low 7 bits
+ * of each byte can't carry into the next, so the top bit of each byte of
+ * l + (0x80 - 'A') is set if the byte is at least 'A', and of
+ * l + (0x80 - 'Z' - 1) if it is beyond 'Z'. Bytes with the top bit set are
+ * never letters. That leaves 0x80 in each letter byte, and shifting it down
+ * gives the 0x20 to flip.
+ */
+static inline uint32_t invert_word(uint32_t w)
+{
+	uint32_t x = w & 0xdfdfdfdf;
+	uint32_t l = x & 0x7f7f7f7f;
+	uint32_t ge_a = l + 0x3f3f3f3f;
+	uint32_t gt_z = l + 0x25252525;
+
+	return w ^ ((ge_a & ~gt_z & ~x & 0x80808080) >> 2);
+}
+#endif /* __mips_dsp */
+
+void case_invert(uint8_t *out, const uint8_t *in, int len)
+{
+	word_t *out_word;
+	int head = -(uintptr_t)out & 3;
+
+	/* Bytes up to a word boundary in out */
+	if (head > len)
+		head = len;
+	case_invert_bytes(out, in, head);
+	out += head;
+	in += head;
+	len -= head;
+
+	out_word = (word_t *)out;
+	if (!((uintptr_t)in & 3)) {
+		const word_t *in_word = (const word_t *)in;
+
+		for (; len >= 4; len -= 4)
+			*out_word++ = invert_word(*in_word++);
+		in = (const uint8_t *)in_word;
+	} else {
+		const struct unaligned_word *in_word = (const struct unaligned_word *)in;
+
+		for (; len >= 4; len -= 4)
+			*out_word++ = invert_word((in_word++)->w);
+		in = (const uint8_t *)in_word;
+	}
+
+	/* And any bytes left over */
+	case_invert_bytes((uint8_t *)out_word, in, len);
+}
+
+#ifdef TEST
+
+/* Buffer size for the benchmark, about one vring buffer */
+#define BENCH_SIZE	4096
+#define BENCH_ITERATIONS 20000
+
+static inline unsigned long long cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static double bench(void (*fn)(uint8_t *, const uint8_t *, int),
+		    uint8_t *out, const uint8_t *in, int len)
+{
+	unsigned long long start;
+	int i;
+
+	start = cycles();
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		fn(out, in, len);
+		/* Don't let the calls be merged */
+		__asm__ __volatile__("" : : "r" (out) : "memory");
+	}
+	return (double)(cycles() - start) / BENCH_ITERATIONS / len;
+}
+
+int main(int argc, char *argv[])
+{
+	static uint8_t in[BENCH_SIZE + 8], out[BENCH_SIZE + 8], ref[BENCH_SIZE + 8];
+	int i, in_off, out_off, len;
+
+	/* Every byte value, at every alignment and length around a few words */
+	for (i = 0; i < sizeof(in); i++)
+		in[i] = i;
+	for (in_off = 0; in_off < 4; in_off++)
+		for (out_off = 0; out_off < 4; out_off++)
+			for (len = 0; len <= 256 + 8; len++) {
+				memset(out, 0xaa, sizeof(out));
+				memset(ref, 0xaa, sizeof(ref));
+				case_invert(&out[out_off], &in[in_off], len);
+				case_invert_bytes(&ref[out_off], &in[in_off], len);
+				if (memcmp(out, ref, sizeof(out))) {
+					printf("FAIL in +%d out +%d len %d\n", in_off, out_off, len);
+					return 1;
+				}
+			}
+	printf("case_invert matches case_invert_bytes\n");
+
+	/* Mostly text, as the firmware would be sent */
+	srand(1);
+	for (i = 0; i < sizeof(in); i++)
+		in[i] = 0x20 + rand() % 0x5f;
+
+#if defined(__x86_64__) || defined(__i386__)
+	printf("\n%-22s %10s\n", "", "cycles/byte");
+#else
+	printf("\n%-22s %10s\n", "", "ns/byte");
+#endif
+	printf("%-22s %10.3f\n", "bytes", bench(case_invert_bytes, out, in, BENCH_SIZE));
+	printf("%-22s %10.3f\n", "words, aligned", bench(case_invert, out, in, BENCH_SIZE));
+	printf("%-22s %10.3f\n", "words, unaligned in", bench(case_invert, out, in + 1, BENCH_SIZE));
+	printf("%-22s %10.3f\n", "words, unaligned both", bench(case_invert, out + 3, in + 1, BENCH_SIZE));
+	return 0;
+}
+#endif /* TEST */
@@ -36,8 +36,25 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+/*
+ * The defines below are the defaults for the configuration block in the vdev
+ * resource (see fw_config.h), which Linux may rewrite to change them at run
+ * time. They take effect from the next kick.
+ */
+
+/*
+ * How incoming buffers are serviced:
+ * 0 - Interrupt driven. Each kick from Linux raises an interrupt.
+ * 1 - Polled. Spin checking for kicks from Linux.
+ * 2 - Hybrid. Take an interrupt, then mask it and poll the incoming vring
+ *     until it has been empty for poll_budget CP0 Count cycles, before
+ *     unmasking the interrupt and waiting again.
+ */
 #define POLLED_MODE 0
 
+/* Initial poll_budget for POLLED_MODE 2 */
+#define POLL_BUDGET 100000
+
 /*
  * If your kernel is configured to use coherent DMA, set this to 1.
  * If the kernel is using coherent DMA, it will access shared buffers cached,
@@ -47,14 +64,37 @@
  */
 #define DMA_COHERENT 0
 
+/*
+ * If the kernel is not using coherent DMA, the firmware may still access the
+ * buffers cached if it maintains the cache itself. Set this to 1 to map the
+ * buffers through KSEG0, invalidating incoming data before reading it and
+ * writing back outgoing data before returning it, rather than making every
+ * access uncached through KSEG1. Has no effect if DMA_COHERENT is 1.
+ */
+#define DMA_CACHE_OPS 0
+
+/* What is written to the trace buffer, see trace.h */
+#define TRACE_LEVEL TRACE_LEVEL_ALL
+
+#include <asm/cache.h>
 #include <asm/remoteproc.h>
+#include <bulk.h>
+#include <console.h>
+#include <fw_config.h>
+#include <gic.h>
 #include <printf.h>
+#include <rpmsg.h>
+#include <rsc_table.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <trace.h>
 #include <vring.h>
 
-#define GIC_LOCAL_INTERRUPTS 7
+#include "service.h"
+
+/* Carveout Linux allocates for bulk data, and the size of its slots */
+#define BULK_CARVEOUT_SIZE	0x100000
+#define BULK_SLOT_SIZE		0x10000
 
 extern const char _start[], _end[];
 
@@ -62,270 +102,188 @@ extern const char _start[], _end[];
  * Resource table describe to remoteproc core the capabilities of
  * this firmware
  */
-struct __resource_table {
-	struct resource_table			header;
-
-	uint32_t				offset[3];
-
-	struct {
-		struct fw_rsc_hdr		header;
-		struct fw_rsc_carveout		carveout;
-	} carveout;
-
-	struct {
-		struct fw_rsc_hdr		header;
-		struct fw_rsc_trace		trace;
-	} trace;
-
-	struct {
-		struct fw_rsc_hdr		header;
-		struct fw_rsc_vdev		vdev;
-		struct fw_rsc_vdev_vring	vring[2];
-		uint8_t				config[0xc];
-	} vdev;
-} volatile resource_table __attribute__ ((section (".resource_table"))) = 
+#define RESOURCES(R)							\
+	R(carveout, RSC_CARVEOUT_ENTRY)					\
+	R(bulk, RSC_CARVEOUT_ENTRY)					\
+	R(trace, RSC_TRACE_ENTRY)					\
+	R(vdev, RSC_VDEV_ENTRY(2,					\
+			       struct virtio_console_config config;	\
+			       struct fw_config fw_config;))		\
+	R(rpmsg, RSC_VDEV_ENTRY(2))
+
+RESOURCE_TABLE(RESOURCES) =
 {
-	.header = {
-		.ver = 1,	/* Verison 1 */
-		.num = 3,	/* 3 resources */
-	},
-
-	/* Offsets of the 3 resource headers */
-	.offset[0] = offsetof(struct __resource_table, carveout),
-	.offset[1] = offsetof(struct __resource_table, trace),
-	.offset[2] = offsetof(struct __resource_table, vdev),
+	RSC_TABLE_HEADER(RESOURCES),
 
 	/* Carveout resource to map firmware image into */
-	.carveout = {
-		.header = {
-			.type = RSC_CARVEOUT,
-		},
-		.carveout = {
-			.da = (uint32_t)&_start,
-			.pa = (uint32_t)&_start,
-			.len = 0x10000,//(long)(&_end) - (long)(&_start),
-			.name = "firmware",
-		},
-	},
+	.carveout = RSC_CARVEOUT_INIT((uint32_t)&_start,
+				      0x10000,//(long)(&_end) - (long)(&_start),
+				      "firmware"),
+
+	/* Carveout for bulk data, wherever Linux can allocate it */
+	.bulk = RSC_CARVEOUT_INIT((uint32_t)FW_RSC_ADDR_ANY, BULK_CARVEOUT_SIZE,
+				  "bulk"),
 
 	/* Trace resource to printf() into */
-	.trace = {
-		.header = {
-			.type = RSC_TRACE,
-		},
-		.trace = {
-			.da = (uint32_t)trace_buf,
-			.len = TRACE_BUFFER_SIZE,
-			.name = "trace",
-		},
-	},
+	.trace = RSC_TRACE_INIT((uint32_t)trace_buf, TRACE_BUFFER_SIZE, "trace"),
 
 	/* Virtual device resource for the virtual serial port */
 	.vdev = {
-		.header = {
-			.type = RSC_VDEV,
-		},
+		RSC_VDEV_HEADER,
 		.vdev = {
 			.id = 11, /* VIRTIO_ID_RPROC_SERIAL */
-			.notifyid = 4,
-			.config_len = 0xc,
-			.num_of_vrings = 2,
+			.notifyid = 10,
+			.dfeatures = 1 << VIRTIO_RING_F_EVENT_IDX |
+				     1 << VIRTIO_RING_F_INDIRECT_DESC,
+			.config_len = FW_CONFIG_OFFSET + sizeof(struct fw_config),
+			RSC_VDEV_NUM_VRINGS(vdev),
 		},
-		
-		.vring[0] = {
-			.align = 0x1000,
-			.num = 0x4,
-			.notifyid = 1,
+
+		.vring = {
+			/* Port 0 receive (to Linux) and transmit (from Linux) */
+			RSC_VRING(1), RSC_VRING(0),
 		},
-		
-		.vring[1] = {
-			.align = 0x1000,
-			.num = 0x4,
-			.notifyid = 0,
+
+		.config = {
+			.max_nr_ports = NUM_PORTS,
+		},
+
+		.fw_config = {
+			.mode = POLLED_MODE,
+			.flags = (DMA_COHERENT ? FW_CONFIG_DMA_COHERENT : 0) |
+				 (DMA_CACHE_OPS ? FW_CONFIG_DMA_CACHE_OPS : 0),
+			.trace_level = TRACE_LEVEL,
+			.poll_budget = POLL_BUDGET,
 		},
 	},
-};
 
-struct vring vring_incoming;
-struct vring vring_outgoing;
+	/* Virtual device resource for the rpmsg bus */
+	.rpmsg = {
+		RSC_VDEV_HEADER,
+		.vdev = {
+			.id = VIRTIO_ID_RPMSG,
+			.notifyid = 11,
+			.dfeatures = 1 << VIRTIO_RPMSG_F_NS |
+				     1 << VIRTIO_RING_F_EVENT_IDX,
+			RSC_VDEV_NUM_VRINGS(rpmsg),
+		},
+
+		.vring = {
+			RSC_VRING(9), RSC_VRING(8),
+		},
+	},
+};
 
-int interrupt_from_linux, interrupt_to_linux;
+/* The IPIs from and to Linux */
+struct gic_ipi ipi;
 
-void *cm_base;
-void *gic_base;
+/* Offsets of KSEG0 and KSEG1, to access physical addresses cached or not */
+#define KSEG0_OFFSET	((long)0x80000000)
+#define KSEG1_OFFSET	((long)0xA0000000)
 
-static inline void *phys_to_virt(void *phys, int cached)
+unsigned int read_count(void)
 {
-	/* Calculate a KSEG0/KSEG1 address for a pointer */
-	if (cached)
-		return phys + 0xFFFFFFFF80000000;
-	else
-		return phys + 0xFFFFFFFFA0000000;
+	unsigned int count;
+
+	/* CP0 Count */
+	__asm__ __volatile__("mfc0 %0, $9" : "=r" (count));
+	return count;
 }
 
-void configure_interrupts(int irq_from_host, int irq_to_host)
+void poll_idle(void)
 {
-	long flags;
-	int **gcr_gic_base;
+}
 
-	/* Determine the base address of the CM */
-	__asm__("mfc0 %0, $15, 3" : "=r" (cm_base));
-	cm_base = (void*)((int)cm_base << 4);
-	cm_base = phys_to_virt(cm_base, 0);
-	printf("CM base address: 0x%08x\n", (int)cm_base);
+/* Enable the interrupt associated with linux -> remote */
+void unmask_irq_from_host(void)
+{
+	gic_irq_unmask(&ipi.from_host);
+}
 
-	/*
-	 * The CM register GCR_GIC_BASE register contains the base address of
-	 * the GIC - read the base address from it
-	 */
-	gcr_gic_base = cm_base + 0x80;
-	gic_base = *gcr_gic_base;
-	gic_base = phys_to_virt((void*)((int)gic_base & ~1), 0);
-	printf("GIC base address: 0x%08x\n", (int)gic_base);
+/* Disable the interrupt associated with linux -> remote */
+void mask_irq_from_host(void)
+{
+	gic_irq_mask(&ipi.from_host);
+}
 
-	/*
-	 * Ensure all local interrupts (i.e the timer) are disabled
-	 * Write to the GIC local reset mask register to clear all.
-	 */
-	*(int*)(gic_base + 0x8000 + 0xC) = 0x7F;
+void configure_interrupts(int from_host, int to_host)
+{
+	gic_init();
+	gic_ipi_init(&ipi, from_host, to_host);
 
 	/*
-	 * The IPI numbers provided by Linux are offset by the number
-	 * of local interrupts in the GIC
+	 * Enable the incoming IRQ, unless polling for it. Interrupts are
+	 * enabled whatever the mode, so that Linux can switch to another.
 	 */
-	interrupt_from_linux = irq_from_host - GIC_LOCAL_INTERRUPTS;
-	interrupt_to_linux = irq_to_host - GIC_LOCAL_INTERRUPTS;
-
-#if POLLED_MODE == 0
-	/* Enable the incoming IRQ */
-	{
-		volatile int *gic_set_mask_reg = (int*)((int)gic_base + 0x0380 + ((interrupt_from_linux / 32) * 4));
-		int gic_set_mask_bit = interrupt_from_linux % 32;
-
-		/* Write to the GIC set mask register to enable interrupt */
-		*gic_set_mask_reg = 1 << gic_set_mask_bit;
-		__asm__("sync");
-		__asm__("ehb");
-	}
+	if (config.mode != FW_MODE_POLLED)
+		unmask_irq_from_host();
 
 	/* Enable interrupts! */
-	__asm__("mfc0 %0, $12, 0" : "=r" (flags));
-	flags |= 1 << 10; /* IM2 */
-	flags |= 1; /* IE */
-	__asm__("mtc0 %0, $12, 0" : : "r" (flags));
-	__asm__("ehb");
-#endif /* POLLED_MODE */
+	gic_cpu_irq_enable();
 }
 
 /* Is the interrupt associated with linux -> remote asserted? */
-int gic_irq_from_host(void)
+int irq_from_host(void)
 {
-	volatile int *gic_pending_reg = (int*)((int)gic_base + 0x0480 + ((interrupt_from_linux / 32) * 4));
-	int gic_pending_bit = interrupt_from_linux % 32;
-
-	if ((*gic_pending_reg) & (1 << gic_pending_bit)) {
-		/* Ack the interrupt */
-		volatile int *gic_wedge_reg = (int*)((int)gic_base + 0x0280);
-
-		*gic_wedge_reg = interrupt_from_linux;
-
-		return 1;
-	}
-	return 0;
+	return gic_irq_ack(&ipi.from_host);
 }
 
 /* Assert the interrupt associated with remote -> linux */
-void gic_irq_to_host(void)
-{
-	volatile int *gic_wedge_reg = (int*)((int)gic_base + 0x0280);
-
-	printf("Asserting IRQ %d\n", interrupt_to_linux);
-	*gic_wedge_reg = (1 << 31) | interrupt_to_linux;
-}
-
-
-void handle_buffer(void *buffer, int len)
-{
-	uint8_t *out_buf;
-	uint8_t *in_buf = phys_to_virt(buffer, DMA_COHERENT);
-	int out_len;
-	int i;
-
-	/* Get a buffer in the outgoing vring */
-	if (!vring_get_buffer(&vring_outgoing, &buffer, &out_len))
-		return;
-	printf("Got outgoing buffer length %d at 0x%08x\n", out_len, buffer);
-	out_buf = phys_to_virt(buffer, DMA_COHERENT);
-
-	printf("Incoming %d bytes at 0x%08x\n", len, (int)in_buf);
-	for (i = 0; (i < len) && (i < out_len); i++) {
-		printf(" 0x%02x: 0x%02x\n", i, in_buf[i]);
-
-		/*
-		 * Copy the incoming data to the outgoing buffer
-		 * Swap the case of alphabetic characters
-		 */
-		if (in_buf[i] >= 'a' && in_buf[i] <= 'z')
-			out_buf[i] = in_buf[i] - 0x20;
-		else if (in_buf[i] >= 'A' && in_buf[i] <= 'Z')
-			out_buf[i] = in_buf[i] + 0x20;
-		else
-			out_buf[i] = in_buf[i];
-	}
-
-	/* Send the outgoing buffer to the host */
-	vring_put_buffer(&vring_outgoing, buffer, i);
-}
-
-
-void check_and_handle_incoming_buffers(void)
+void irq_to_host(void)
 {
-	int len;
-	void *buf;
-
-	if (gic_irq_from_host()) {
-		/* Linux has asserted the incoming IPI */
-		trace_clear();
-
-		/* Handle all newly available buffers */
-		while (vring_get_buffer(&vring_incoming, &buf, &len)) {
-			handle_buffer(buf, len);
-
-			vring_put_buffer(&vring_incoming, buf, len);
-		}
-		printf("Incoming vring:\n");
-		vring_print(&vring_incoming);
-		printf("Outgoing vring:\n");
-		vring_print(&vring_outgoing);
-
-		/* Send IPI to Linux to deal with consumed buffers */
-		gic_irq_to_host();
-	}
+	TRACE("Asserting IRQ %d", ipi.to_host.irq);
+	gic_irq_raise(&ipi.to_host);
 }
 
-void handle_interrupt(void)
+/*
+ * Wait for the interrupt to switch us to polling. Interrupts are disabled
+ * around the check, so one arriving just before the wait cannot be missed -
+ * the core still leaves WAIT for a pending interrupt while Status.IE is clear
+ * (Config7.WII, as on interAptiv).
+ */
+static inline void wait_for_interrupt(void)
 {
-	check_and_handle_incoming_buffers();
+	__asm__ __volatile__("di; ehb" : : : "memory");
+	if (!polling)
+		__asm__ __volatile__("wait");
+	__asm__ __volatile__("ei; ehb" : : : "memory");
 }
 
 void main(int fw_arg0, int fw_arg1, int fw_arg2, int fw_arg3)
 {
+	cache_init();
+
 	/*
-	 * Initialise the incoming and outgoing vrings from
-	 * value passed to us in the resource table
+	 * Start with the configuration Linux has left in the resource table,
+	 * which it writes coherently only if DMA is coherent
 	 */
-	vring_init(&vring_outgoing, &resource_table.vdev.vring[0]);
-	vring_init(&vring_incoming, &resource_table.vdev.vring[1]);
+	config.flags = DMA_COHERENT ? FW_CONFIG_DMA_COHERENT : 0;
+	service_init(&resource_table.vdev.vdev, &resource_table.rpmsg.vdev,
+		     &resource_table.vdev.fw_config, KSEG0_OFFSET, KSEG1_OFFSET);
+	printf("Mode %d, flags 0x%x, poll budget %d\n",
+	       config.mode, config.flags, config.poll_budget);
+
+	/* Lay out the bulk carveout, now its header can be written */
+	bulk_init(&bulk, &resource_table.bulk.carveout, BULK_SLOT_SIZE);
 
 	/* Set up the GIC */
 	configure_interrupts(fw_arg1, fw_arg2);
 
 	while(1) {
-#if POLLED_MODE == 1
-		check_and_handle_incoming_buffers();
-#else
-		__asm__("wait");
-#endif /* POLLED_MODE */
+		switch (config.mode) {
+		case FW_MODE_POLLED:
+			check_and_handle_incoming_buffers();
+			break;
+		case FW_MODE_HYBRID:
+			if (polling)
+				poll_incoming_buffers();
+			else
+				wait_for_interrupt();
+			break;
+		default:
+			__asm__("wait");
+			break;
+		}
 	}
 }
 
@@ -334,3 +292,8 @@ int putchar(char c)
 	/* Printf should be directed to the trace buffer */
 	trace_putc(c);
 }
+
+void printf_write(const char *s, int len)
+{
+	trace_puts(s, len);
+}
@@ -0,0 +1,458 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <asm/cache.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <trace.h>
+#include <vring.h>
+
+#include "invert.h"
+#include "service.h"
+
+volatile struct fw_config config;
+
+struct console console;
+struct console_port ports[NUM_PORTS] = {
+	{
+		.name = "case-invert",
+	},
+};
+
+struct bulk bulk;
+
+struct rpmsg_device rpmsg;
+
+/* The configuration block, which Linux may rewrite */
+static volatile struct fw_config *fw_config;
+
+/* Offsets from physical addresses to cached and uncached virtual addresses */
+static long cached_offset, uncached_offset;
+
+static inline void *phys_to_virt(void *phys, int cached)
+{
+	return phys + (cached ? cached_offset : uncached_offset);
+}
+
+/* Whether buffer contents are accessed through the cache */
+static inline int dma_buffers_cached(void)
+{
+	return config.flags & (FW_CONFIG_DMA_COHERENT | FW_CONFIG_DMA_CACHE_OPS);
+}
+
+/* Whether the firmware must maintain the cache for the buffers */
+static inline int dma_buffers_synced(void)
+{
+	return (config.flags & (FW_CONFIG_DMA_COHERENT | FW_CONFIG_DMA_CACHE_OPS)) ==
+		FW_CONFIG_DMA_CACHE_OPS;
+}
+
+/* Make data Linux has written to a buffer visible to the firmware */
+static inline void dma_sync_for_cpu(void *buf, int len)
+{
+	if (dma_buffers_synced())
+		dcache_inv_range(buf, len);
+}
+
+/* Make data the firmware has written to a buffer visible to Linux */
+static inline void dma_sync_for_device(void *buf, int len)
+{
+	if (dma_buffers_synced())
+		dcache_wback_inv_range(buf, len);
+}
+
+/*
+ * Case invert an incoming buffer into a buffer from the outgoing vring.
+ * Either buffer may be a chain of several segments.
+ */
+static void handle_buffer(struct console_port *port, struct vring_iter *in)
+{
+	struct vring_iter out;
+	uint8_t *in_buf = NULL, *out_buf = NULL;
+	int in_len = 0, out_len = 0, total = 0;
+	int out_head;
+	void *buffer;
+	int i;
+
+	/* Get a buffer in the outgoing vring */
+	out_head = vring_get_chain(&port->outgoing, &out);
+	if (out_head < 0)
+		return;
+
+	while (1) {
+		/* Move on to the next segment of each buffer as it is used up */
+		if (!in_len) {
+			if (!vring_iter_next(in, &buffer, &in_len, NULL))
+				break;
+			in_buf = phys_to_virt(buffer, dma_buffers_cached());
+			dma_sync_for_cpu(in_buf, in_len);
+			TRACE("Incoming %d bytes at 0x%08x", in_len, (long)in_buf);
+			continue;
+		}
+		if (!out_len) {
+			if (!vring_iter_next(&out, &buffer, &out_len, NULL))
+				break;
+			out_buf = phys_to_virt(buffer, dma_buffers_cached());
+			TRACE("Got outgoing buffer length %d at 0x%08x", out_len, (long)buffer);
+			continue;
+		}
+
+		/*
+		 * Copy the incoming data, swapping the case of letters. No stale
+		 * lines may be left under the outgoing data, as the partly
+		 * written ones would be written back over Linux's.
+		 */
+		i = in_len < out_len ? in_len : out_len;
+		dma_sync_for_cpu(out_buf, i);
+		case_invert(out_buf, in_buf, i);
+		dma_sync_for_device(out_buf, i);
+
+		TRACE(" 0x%02x: %d bytes", total, i);
+
+		in_buf += i;
+		in_len -= i;
+		out_buf += i;
+		out_len -= i;
+		total += i;
+	}
+
+	/* Queue the outgoing buffer for the host */
+	vring_stage_buffer_head(&port->outgoing, out_head, total);
+}
+
+/* Reply to each message to the rpmsg endpoint with its case inversion */
+static void rpmsg_case_invert(struct rpmsg_device *rdev, struct rpmsg_endpoint *ept,
+			      const void *data, int len, uint32_t src)
+{
+	uint8_t *buf;
+	int size;
+
+	buf = rpmsg_get_tx_buffer(rdev, &size);
+	if (!buf) {
+		TRACE("No rpmsg buffer to reply to %d", src);
+		return;
+	}
+
+	if (len > size)
+		len = size;
+	case_invert(buf, data, len);
+	rpmsg_send_nocopy(rdev, ept->addr, src, len);
+}
+
+/*
+ * Case invert, in place, the slots of the bulk carveout named by the
+ * descriptors in a message, then reply with the descriptors, with the lengths
+ * handled. The data itself never passes through the vrings.
+ */
+static void rpmsg_case_invert_slots(struct rpmsg_device *rdev, struct rpmsg_endpoint *ept,
+				    const void *data, int len, uint32_t src)
+{
+	const struct bulk_desc *in_desc = data;
+	struct bulk_desc *out_desc;
+	uint8_t *slot;
+	int size, n;
+
+	out_desc = rpmsg_get_tx_buffer(rdev, &size);
+	if (!out_desc) {
+		TRACE("No rpmsg buffer to reply to %d", src);
+		return;
+	}
+
+	/* A reply has room for as many descriptors as a message */
+	len /= sizeof(*in_desc);
+	for (n = 0; n < len && n < size / (int)sizeof(*out_desc); n++) {
+		out_desc[n] = in_desc[n];
+		slot = bulk_slot(&bulk, &out_desc[n]);
+		if (!slot) {
+			TRACE("No bulk slot %d", out_desc[n].slot);
+			continue;
+		}
+
+		slot = phys_to_virt(slot, dma_buffers_cached());
+		dma_sync_for_cpu(slot, out_desc[n].len);
+		case_invert(slot, slot, out_desc[n].len);
+		dma_sync_for_device(slot, out_desc[n].len);
+
+		TRACE(" Slot %d: %d bytes", out_desc[n].slot, out_desc[n].len);
+	}
+
+	rpmsg_send_nocopy(rdev, ept->addr, src, n * sizeof(*out_desc));
+}
+
+/* rpmsg endpoints, each announced to Linux to create an rpmsg device */
+struct rpmsg_endpoint rpmsg_endpoints[] = {
+	{
+		.name = "rpmsg-case-invert",
+		.addr = RPMSG_RESERVED_ADDRESSES,
+		.cb = rpmsg_case_invert,
+	},
+	{
+		.name = "rpmsg-case-invert-slots",
+		.addr = RPMSG_RESERVED_ADDRESSES + 1,
+		.cb = rpmsg_case_invert_slots,
+	},
+};
+
+/*
+ * Handle all available buffers on a port with handler, and return them to
+ * Linux
+ * \return number of buffers handled
+ */
+static int handle_incoming_buffers(struct console_port *port,
+				   void (*handler)(struct console_port *port, struct vring_iter *in))
+{
+	struct vring_iter iter;
+	int head, handled = 0;
+
+	while ((head = vring_get_chain(&port->incoming, &iter)) >= 0) {
+		handler(port, &iter);
+
+		/* The whole chain has been consumed */
+		vring_stage_buffer_head(&port->incoming, head, vring_iter_finish(&iter));
+		handled++;
+	}
+
+	if (!handled)
+		return 0;
+
+	/* Return the whole batch to Linux */
+	vring_publish_used(&port->outgoing);
+	vring_publish_used(&port->incoming);
+
+	/* Send IPI to Linux to deal with consumed buffers, if it wants one */
+	if (vring_need_notify(&port->outgoing) | vring_need_notify(&port->incoming))
+		irq_to_host();
+
+	return handled;
+}
+
+/*
+ * Handle console control messages, then the buffers on each active port
+ * \return number of control messages and buffers handled
+ */
+static int handle_console(void)
+{
+	int handled = console_handle_control(&console);
+	int i;
+
+	for (i = 0; i < NUM_PORTS; i++)
+		if (ports[i].active)
+			handled += handle_incoming_buffers(&ports[i], handle_buffer);
+
+	return handled;
+}
+
+unsigned int poll_switches;
+unsigned int mode_switches;
+volatile int polling;
+
+/* Set when the incoming interrupt is to be unmasked once the vrings are drained */
+static int unmask_after_drain;
+
+/* Copy the configuration block, which Linux may have rewritten, into config */
+static void read_config(void)
+{
+	long offset;
+
+	/* Linux writes the block uncached unless DMA is coherent */
+	if (!(config.flags & FW_CONFIG_DMA_COHERENT))
+		dcache_inv_range((void *)fw_config, sizeof(*fw_config));
+
+	if (fw_config->mode <= FW_MODE_HYBRID)
+		config.mode = fw_config->mode;
+	config.flags = fw_config->flags;
+	config.poll_budget = fw_config->poll_budget;
+	config.trace_level = trace_level = fw_config->trace_level;
+
+	/*
+	 * The vrings, indirect descriptor tables, control messages and the
+	 * bulk carveout header are accessed without cache maintenance, so
+	 * through KSEG0 only when DMA is coherent and otherwise through KSEG1,
+	 * even when FW_CONFIG_DMA_CACHE_OPS has the buffers accessed cached
+	 */
+	offset = (long)phys_to_virt(NULL, config.flags & FW_CONFIG_DMA_COHERENT);
+	console_set_phys_offset(&console, offset);
+	bulk_set_phys_offset(&bulk, offset);
+
+	/* rpmsg buffers are small, and accessed without cache maintenance */
+	rpmsg_set_phys_offset(&rpmsg, offset);
+}
+
+/*
+ * Re-read the configuration on a kick from Linux, switching the incoming
+ * interrupt on or off if the mode has changed. While polling in hybrid mode
+ * the interrupt stays masked, and is dealt with when polling stops.
+ */
+void update_config(void)
+{
+	int mode = config.mode;
+
+	read_config();
+	if (config.mode == mode)
+		return;
+
+	TRACE("Switching from mode %d to mode %d", mode, config.mode);
+	mode_switches++;
+	if (polling)
+		return;
+
+	/*
+	 * Coming out of polled mode, the vrings are drained with interrupts
+	 * enabled, so the interrupt is left masked until that has finished.
+	 * Otherwise the next kick would run the handlers again, in the middle
+	 * of the drain.
+	 */
+	if (config.mode == FW_MODE_POLLED) {
+		unmask_after_drain = 0;
+		mask_irq_from_host();
+	} else {
+		unmask_after_drain = 1;
+	}
+}
+
+void check_and_handle_incoming_buffers(void)
+{
+	if (irq_from_host()) {
+		/* Linux has asserted the incoming IPI */
+		update_config();
+
+		/*
+		 * Handle all newly available rpmsg messages and buffers, until
+		 * Linux has been asked to notify us of any more. The short
+		 * rpmsg messages go first, so they don't wait behind a batch of
+		 * bulk buffers.
+		 */
+		do {
+			rpmsg_handle_incoming(&rpmsg);
+			handle_console();
+		} while (console_enable_notify(&console) |
+			 rpmsg_enable_notify(&rpmsg));
+
+		TRACE("Incoming avail %d used %d, outgoing avail %d used %d",
+		      ports[0].incoming.avail_index,
+		      ports[0].incoming.used_index,
+		      ports[0].outgoing.avail_index,
+		      ports[0].outgoing.used_index);
+
+		if (unmask_after_drain) {
+			unmask_after_drain = 0;
+			unmask_irq_from_host();
+		}
+	}
+}
+
+/*
+ * Poll the incoming vring until nothing has arrived for poll_budget counts.
+ * Linux is not asked to kick us while polling, since we will see new buffers
+ * anyway.
+ */
+void poll_incoming_buffers(void)
+{
+	unsigned int idle_start = read_count();
+	int handled = 0, n;
+
+	poll_switches++;
+	update_config();
+
+	while (1) {
+		n = rpmsg_handle_incoming(&rpmsg);
+		n += handle_console();
+		if (n) {
+			handled += n;
+			idle_start = read_count();
+			continue;
+		}
+
+		if (read_count() - idle_start < config.poll_budget) {
+			poll_idle();
+			continue;
+		}
+
+		/*
+		 * Out of budget. Clear any kick that arrived while polling, then
+		 * ask Linux to kick us again - anything it makes available after
+		 * this point will leave the interrupt pending.
+		 */
+		irq_from_host();
+		if (!(console_enable_notify(&console) |
+		      rpmsg_enable_notify(&rpmsg)))
+			break;
+	}
+
+	TRACE("Polled %d buffers, switch %d, budget %d",
+	      handled, poll_switches, config.poll_budget);
+
+	polling = 0;
+	if (config.mode != FW_MODE_POLLED)
+		unmask_irq_from_host();
+}
+
+void handle_interrupt(void)
+{
+	if (config.mode == FW_MODE_HYBRID) {
+		/* Mask the interrupt and leave the buffers to the main loop */
+		mask_irq_from_host();
+		polling = 1;
+	} else {
+		check_and_handle_incoming_buffers();
+	}
+}
+
+void service_init(volatile struct fw_rsc_vdev *serial,
+		  volatile struct fw_rsc_vdev *rpmsg_rsc,
+		  volatile struct fw_config *config_block,
+		  long cached, long uncached)
+{
+	fw_config = config_block;
+	cached_offset = cached;
+	uncached_offset = uncached;
+
+	/*
+	 * The console vrings are set up from the resource table once Linux
+	 * has probed its vdev and negotiated features
+	 */
+	console_init(&console, serial, ports, NUM_PORTS, irq_to_host);
+
+	/* The rpmsg vrings are set up once Linux has probed its vdev */
+	rpmsg_init(&rpmsg, rpmsg_rsc, rpmsg_endpoints,
+		   sizeof(rpmsg_endpoints) / sizeof(rpmsg_endpoints[0]),
+		   irq_to_host);
+
+	/* Start with the configuration Linux has left */
+	read_config();
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __SERVICE_H__
+#define __SERVICE_H__
+
+#include <bulk.h>
+#include <console.h>
+#include <fw_config.h>
+#include <rpmsg.h>
+
+/*
+ * Servicing of the case inversion ports and rpmsg endpoints. This is shared
+ * by the firmware (main.c) and the hosted simulation (sim/sim-firmware.c),
+ * which each provide the platform functions declared at the end, so that the
+ * simulation runs the firmware's own service loop.
+ */
+
+/*
+ * Virtual serial ports. There is only port 0, for bulk data: Linux doesn't
+ * negotiate VIRTIO_CONSOLE_F_MULTIPORT for a remote processor's serial vdev,
+ * and remoteproc only allows a vdev 2 vrings, so further ports couldn't be
+ * reached. Short, latency sensitive messages go to the rpmsg case inversion
+ * endpoint instead, which is serviced first.
+ */
+#define NUM_PORTS		1
+
+/*
+ * The configuration in use, read from the block Linux may rewrite. Until it
+ * is first read, the flags say whether the block is written coherently.
+ */
+extern volatile struct fw_config config;
+
+extern struct console console;
+extern struct console_port ports[NUM_PORTS];
+extern struct bulk bulk;
+extern struct rpmsg_device rpmsg;
+
+/* Number of times servicing has switched from interrupts to polling */
+extern unsigned int poll_switches;
+
+/* Number of changes of mode seen */
+extern unsigned int mode_switches;
+
+/* Set by handle_interrupt to switch to polling */
+extern volatile int polling;
+
+/*
+ * Set up the console and the rpmsg bus, and read the configuration
+ * \param serial	vdev resource of the serial port, with 2 vrings, or
+ * 			CONSOLE_NUM_VRINGS(NUM_PORTS) if Linux is to
+ * 			negotiate multiport
+ * \param rpmsg_rsc	vdev resource of the rpmsg bus
+ * \param config_block	Configuration block Linux may rewrite
+ * \param cached	Offset to access memory Linux refers to by physical
+ * 			address through the cache
+ * \param uncached	The same, bypassing the cache
+ */
+void service_init(volatile struct fw_rsc_vdev *serial,
+		  volatile struct fw_rsc_vdev *rpmsg_rsc,
+		  volatile struct fw_config *config_block,
+		  long cached, long uncached);
+
+/*
+ * Re-read the configuration on a kick from Linux, switching the incoming
+ * interrupt on or off if the mode has changed
+ */
+void update_config(void);
+
+/* Handle everything Linux has sent, if it has kicked us */
+void check_and_handle_incoming_buffers(void);
+
+/*
+ * Poll for buffers and messages until nothing has arrived for poll_budget,
+ * then unmask the incoming interrupt
+ */
+void poll_incoming_buffers(void);
+
+/*
+ * Handle the incoming interrupt, or in hybrid mode mask it and set polling
+ * for the main loop to call poll_incoming_buffers
+ */
+void handle_interrupt(void);
+
+/*
+ * Provided by the platform
+ */
+
+/* Acknowledge the interrupt from Linux. \return non-zero if it was asserted */
+int irq_from_host(void);
+
+/* Assert the interrupt to Linux */
+void irq_to_host(void);
+
+void mask_irq_from_host(void);
+void unmask_irq_from_host(void);
+
+/* Free running count the poll budget is measured in */
+unsigned int read_count(void);
+
+/* Called each time polling finds nothing to do */
+void poll_idle(void);
+
+#endif /* __SERVICE_H__ */
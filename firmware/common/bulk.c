@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <asm/barrier.h>
+#include <asm/cache.h>
+#include <asm/remoteproc.h>
+#include <bulk.h>
+#include <stddef.h>
+#include <trace.h>
+
+void bulk_init(struct bulk *b, volatile struct fw_rsc_carveout *rsc,
+	       uint32_t slot_size)
+{
+	struct bulk_header *header;
+	uint32_t len;
+
+	/* As for the vdevs, the resource table is mapped cached */
+	dcache_inv_range((void *)rsc, sizeof(*rsc));
+
+	b->pa = rsc->pa;
+	b->slot_size = slot_size;
+	b->num_slots = 0;
+
+	/* Linux leaves the address as it was if it couldn't allocate it */
+	len = rsc->len;
+	if (b->pa == (uint32_t)FW_RSC_ADDR_ANY || len <= BULK_SLOT_OFFSET) {
+		TRACE("No bulk carveout");
+		return;
+	}
+	b->num_slots = (len - BULK_SLOT_OFFSET) / slot_size;
+
+	header = (void *)(long)b->pa + b->phys_offset;
+	header->slot_size = slot_size;
+	header->num_slots = b->num_slots;
+	header->slot_offset = BULK_SLOT_OFFSET;
+
+	/* The magic number goes last, once the rest is valid */
+	wmb();
+	header->magic = BULK_MAGIC;
+
+	TRACE("Bulk carveout at 0x%08x, %d slots of %d bytes",
+	      b->pa, b->num_slots, slot_size);
+}
+
+void bulk_set_phys_offset(struct bulk *b, long offset)
+{
+	b->phys_offset = offset;
+}
+
+void *bulk_slot(struct bulk *b, struct bulk_desc *desc)
+{
+	if (desc->slot >= b->num_slots) {
+		desc->len = 0;
+		return NULL;
+	}
+
+	if (desc->len > b->slot_size)
+		desc->len = b->slot_size;
+
+	return (void *)(long)(b->pa + BULK_SLOT_OFFSET + desc->slot * b->slot_size);
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <asm/cache.h>
+#include <stdint.h>
+
+/* MIPS32 CACHE instruction operations */
+#define Hit_Invalidate_D	0x11
+#define Hit_Invalidate_SD	0x13
+#define Hit_Writeback_Inv_D	0x15
+#define Hit_Writeback_Inv_SD	0x17
+
+/* Line sizes in bytes, 0 if there is no such cache */
+static unsigned int dcache_line, scache_line;
+
+#ifdef __mips__
+#define cache_op(op, addr)						\
+	__asm__ __volatile__(						\
+		"	.set	push\n"					\
+		"	.set	noreorder\n"				\
+		"	cache	%0, 0(%1)\n"				\
+		"	.set	pop\n"					\
+		: : "i" (op), "r" (addr) : "memory")
+
+#define read_c0_config(sel)						\
+({									\
+	unsigned int __config;						\
+	__asm__ __volatile__("mfc0 %0, $16, " #sel : "=r" (__config));	\
+	__config;							\
+})
+#else
+/* Hosted build of the common code, see sim/ */
+#define cache_op(op, addr)	do { } while (0)
+#define read_c0_config(sel)	0
+#endif /* __mips__ */
+
+#define CONFIG_M		(1u << 31)	/* Next Config register exists */
+
+void cache_init(void)
+{
+	unsigned int config1 = read_c0_config(1);
+	unsigned int dl = (config1 >> 10) & 7;
+	unsigned int sl = 0;
+
+	if (config1 & CONFIG_M)
+		sl = (read_c0_config(2) >> 4) & 0xf;
+
+	/* Line size fields encode 2 << n bytes, 0 meaning no cache */
+	dcache_line = dl ? 2 << dl : 0;
+	scache_line = sl ? 2 << sl : 0;
+}
+
+/*
+ * Apply op to each line from start to end, and op_partial to lines that are
+ * only partly in the range
+ */
+#define cache_range(op, op_partial, start, end, line)			\
+do {									\
+	uintptr_t __addr = (start) & ~((line) - 1);			\
+	uintptr_t __end = (end);					\
+									\
+	if (__addr != (start)) {					\
+		cache_op(op_partial, __addr);				\
+		__addr += (line);					\
+	}								\
+	for (; __addr + (line) <= __end; __addr += (line))		\
+		cache_op(op, __addr);					\
+	if (__addr < __end)						\
+		cache_op(op_partial, __addr);				\
+} while (0)
+
+void dcache_inv_range(void *start, size_t len)
+{
+	uintptr_t addr = (uintptr_t)start;
+
+	if (!len)
+		return;
+
+	if (dcache_line)
+		cache_range(Hit_Invalidate_D, Hit_Writeback_Inv_D,
+			    addr, addr + len, dcache_line);
+	if (scache_line)
+		cache_range(Hit_Invalidate_SD, Hit_Writeback_Inv_SD,
+			    addr, addr + len, scache_line);
+}
+
+void dcache_wback_inv_range(void *start, size_t len)
+{
+	uintptr_t addr = (uintptr_t)start;
+
+	if (!len)
+		return;
+
+	/* L1 first, so that its dirty lines are in the L2 when that is written back */
+	if (dcache_line)
+		cache_range(Hit_Writeback_Inv_D, Hit_Writeback_Inv_D,
+			    addr, addr + len, dcache_line);
+	if (scache_line)
+		cache_range(Hit_Writeback_Inv_SD, Hit_Writeback_Inv_SD,
+			    addr, addr + len, scache_line);
+}
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <asm/cache.h>
+#include <console.h>
+#include <mem.h>
+#include <stddef.h>
+#include <trace.h>
+
+void console_init(struct console *con, volatile struct fw_rsc_vdev *rsc,
+		  struct console_port *ports, int num_ports,
+		  void (*notify)(void))
+{
+	int i;
+
+	memset(con, 0, sizeof(*con));
+	con->rsc = rsc;
+	con->ports = ports;
+	con->num_ports = num_ports;
+	con->notify = notify;
+
+	for (i = 0; i < num_ports; i++) {
+		ports[i].active = 0;
+		ports[i].open = 0;
+		ports[i].need_add = 0;
+		ports[i].need_name = 0;
+		ports[i].need_open = 0;
+	}
+}
+
+void console_set_phys_offset(struct console *con, long offset)
+{
+	int i;
+
+	con->phys_offset = offset;
+	vring_set_phys_offset(&con->ctrl_incoming, offset);
+	vring_set_phys_offset(&con->ctrl_outgoing, offset);
+
+	for (i = 0; i < con->num_ports; i++) {
+		vring_set_phys_offset(&con->ports[i].incoming, offset);
+		vring_set_phys_offset(&con->ports[i].outgoing, offset);
+	}
+}
+
+void console_set_packed(struct console *con, int packed)
+{
+	con->packed = packed;
+}
+
+/* Set up a pair of vrings, the first carrying data to Linux */
+static void console_vrings_init(struct console *con, struct vring *outgoing,
+				struct vring *incoming,
+				volatile struct fw_rsc_vdev_vring *rsc,
+				uint32_t features)
+{
+	if (con->packed) {
+		vring_init_packed(outgoing, &rsc[0]);
+		vring_init_packed(incoming, &rsc[1]);
+	} else {
+		vring_init(outgoing, &rsc[0]);
+		vring_init(incoming, &rsc[1]);
+	}
+	vring_set_features(outgoing, features);
+	vring_set_features(incoming, features);
+}
+
+/* Set up the vrings once Linux has negotiated features and made them ready */
+static int console_start(struct console *con)
+{
+	volatile struct fw_rsc_vdev *rsc = con->rsc;
+	struct console_port *port;
+	uint32_t features;
+	int i;
+
+	if (con->started)
+		return 1;
+
+	/* As rpmsg_start, the header is written back rather than discarded */
+	dcache_inv_range((void *)rsc, sizeof(*rsc));
+	if (!(rsc->status & VIRTIO_CONFIG_S_DRIVER_OK))
+		return 0;
+
+	features = rsc->gfeatures;
+	con->multiport = !!(features & (1 << VIRTIO_CONSOLE_F_MULTIPORT));
+
+	for (i = 0; i < (con->multiport ? con->num_ports : 1); i++) {
+		port = &con->ports[i];
+
+		/* Port 0 uses the first pair, others follow the control pair */
+		console_vrings_init(con, &port->outgoing, &port->incoming,
+				    &rsc->vring[i ? 2 * i + 2 : 0], features);
+		port->active = 1;
+	}
+
+	if (con->multiport)
+		console_vrings_init(con, &con->ctrl_outgoing, &con->ctrl_incoming,
+				    &rsc->vring[2], features);
+	else
+		/* Without control messages, Linux takes port 0 to be open */
+		con->ports[0].open = 1;
+
+	console_set_phys_offset(con, con->phys_offset);
+	con->started = 1;
+	TRACE("Console started, features 0x%x", features);
+	return 1;
+}
+
+/*
+ * Send a control message, with name (if not NULL) following it
+ * \return non-zero when sent, or 0 if Linux has no buffer free
+ */
+static int console_send_control(struct console *con, uint32_t id,
+				uint16_t event, uint16_t value, const char *name)
+{
+	struct virtio_console_control *msg;
+	char *msg_name;
+	int head, len, i = 0;
+	void *buf;
+
+	head = vring_get_buffer_head(&con->ctrl_outgoing, &buf, &len);
+	if (head < 0)
+		return 0;
+
+	msg = buf + con->phys_offset;
+	msg->id = id;
+	msg->event = event;
+	msg->value = value;
+
+	/* Linux terminates the name itself */
+	msg_name = (char *)(msg + 1);
+	for (; name && name[i] && sizeof(*msg) + i < len; i++)
+		msg_name[i] = name[i];
+
+	vring_stage_buffer_head(&con->ctrl_outgoing, head, sizeof(*msg) + i);
+	TRACE("Console control to Linux: id %d event %d value %d", id, event, value);
+	return 1;
+}
+
+/* Send the control messages that are due, in order, while Linux has buffers */
+static void console_send_pending(struct console *con)
+{
+	struct console_port *port;
+	int i;
+
+	for (i = 0; i < con->num_ports; i++) {
+		port = &con->ports[i];
+
+		if (port->need_add) {
+			if (!console_send_control(con, i, VIRTIO_CONSOLE_PORT_ADD, 1, NULL))
+				return;
+			port->need_add = 0;
+		}
+
+		if (port->need_name) {
+			if (!console_send_control(con, i, VIRTIO_CONSOLE_PORT_NAME, 1, port->name))
+				return;
+			port->need_name = 0;
+		}
+
+		/* Linux won't write to a port until we have opened it */
+		if (port->need_open) {
+			if (!console_send_control(con, i, VIRTIO_CONSOLE_PORT_OPEN, 1, NULL))
+				return;
+			port->need_open = 0;
+		}
+	}
+}
+
+/* Act on a control message from Linux */
+static void console_control(struct console *con, struct virtio_console_control *msg)
+{
+	struct console_port *port;
+	int i;
+
+	TRACE("Console control from Linux: id %d event %d value %d",
+	      msg->id, msg->event, msg->value);
+
+	if (msg->event == VIRTIO_CONSOLE_DEVICE_READY) {
+		/* Tell Linux about every port */
+		if (msg->value)
+			for (i = 0; i < con->num_ports; i++)
+				con->ports[i].need_add = 1;
+		return;
+	}
+
+	if (msg->id >= con->num_ports)
+		return;
+	port = &con->ports[msg->id];
+
+	switch (msg->event) {
+	case VIRTIO_CONSOLE_PORT_READY:
+		if (msg->value) {
+			port->need_name = port->name != NULL;
+			port->need_open = 1;
+		}
+		break;
+
+	case VIRTIO_CONSOLE_PORT_OPEN:
+		port->open = msg->value;
+		break;
+	}
+}
+
+int console_handle_control(struct console *con)
+{
+	int head, len, in, out, handled = 0;
+	void *buf;
+
+	if (!console_start(con) || !con->multiport)
+		return 0;
+
+	while ((head = vring_get_buffer_head(&con->ctrl_incoming, &buf, &len)) >= 0) {
+		if (len >= (int)sizeof(struct virtio_console_control))
+			console_control(con, buf + con->phys_offset);
+
+		vring_stage_buffer_head(&con->ctrl_incoming, head, len);
+		handled++;
+	}
+
+	console_send_pending(con);
+
+	in = con->ctrl_incoming.used_staged;
+	out = con->ctrl_outgoing.used_staged;
+	if (!in && !out)
+		return handled;
+
+	vring_publish_used(&con->ctrl_outgoing);
+	vring_publish_used(&con->ctrl_incoming);
+
+	/* Send IPI to Linux to deal with the control messages, if it wants one */
+	if ((out && vring_need_notify(&con->ctrl_outgoing)) |
+	    (in && vring_need_notify(&con->ctrl_incoming)))
+		con->notify();
+
+	return handled;
+}
+
+int console_enable_notify(struct console *con)
+{
+	int i, pending = 0;
+
+	if (!con->started)
+		return 0;
+
+	if (con->multiport)
+		pending |= vring_enable_notify(&con->ctrl_incoming);
+
+	for (i = 0; i < con->num_ports; i++)
+		if (con->ports[i].active)
+			pending |= vring_enable_notify(&con->ports[i].incoming);
+
+	return pending;
+}
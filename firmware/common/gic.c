@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <gic.h>
+#include <printf.h>
+
+/* The CM and GIC registers are accessed uncached, through KSEG1 */
+#define KSEG1(phys)	((void *)(long)(phys) + 0xFFFFFFFFA0000000)
+
+static void *gic_base;
+
+void gic_init(void)
+{
+	volatile uint32_t *local_rmask;
+	void *cm_base;
+	long gcr_base;
+
+	/* Determine the base address of the CM */
+	__asm__("mfc0 %0, $15, 3" : "=r" (gcr_base));
+	cm_base = KSEG1(gcr_base << 4);
+	printf("CM base address: 0x%08x\n", (int)cm_base);
+
+	/*
+	 * The CM register GCR_GIC_BASE register contains the base address of
+	 * the GIC - read the base address from it
+	 */
+	gic_base = KSEG1(*(volatile uint32_t *)(cm_base + GCR_GIC_BASE) & ~1);
+	printf("GIC base address: 0x%08x\n", (int)gic_base);
+
+	/*
+	 * Ensure all local interrupts (i.e the timer) are disabled
+	 * Write to the GIC local reset mask register to clear all.
+	 */
+	local_rmask = gic_base + GIC_VPE_LOCAL + GIC_VPE_RMASK;
+	*local_rmask = GIC_VPE_RMASK_ALL;
+}
+
+void gic_irq_init(struct gic_irq *irq, int num)
+{
+	int offset = (num / 32) * 4;
+
+	irq->irq = num;
+	irq->bit = 1 << (num % 32);
+	irq->pend = gic_base + GIC_SH_PEND + offset;
+	irq->smask = gic_base + GIC_SH_SMASK + offset;
+	irq->rmask = gic_base + GIC_SH_RMASK + offset;
+	irq->wedge = gic_base + GIC_SH_WEDGE;
+}
+
+void gic_ipi_init(struct gic_ipi *ipi, int irq_from_host, int irq_to_host)
+{
+	gic_irq_init(&ipi->from_host, irq_from_host - GIC_LOCAL_INTERRUPTS);
+	gic_irq_init(&ipi->to_host, irq_to_host - GIC_LOCAL_INTERRUPTS);
+}
+
+void gic_irq_mask(struct gic_irq *irq)
+{
+	*irq->rmask = irq->bit;
+	__asm__("sync");
+	__asm__("ehb");
+}
+
+void gic_irq_unmask(struct gic_irq *irq)
+{
+	*irq->smask = irq->bit;
+	__asm__("sync");
+	__asm__("ehb");
+}
+
+void gic_cpu_irq_enable(void)
+{
+	long flags;
+
+	__asm__("mfc0 %0, $12, 0" : "=r" (flags));
+	flags |= 1 << 10; /* IM2 */
+	flags |= 1; /* IE */
+	__asm__("mtc0 %0, $12, 0" : : "r" (flags));
+	__asm__("ehb");
+}
+
+void gic_cpu_irq_disable(void)
+{
+	long flags;
+
+	__asm__("mfc0 %0, $12, 0" : "=r" (flags));
+	flags &= ~1; /* IE */
+	__asm__("mtc0 %0, $12, 0" : : "r" (flags));
+	__asm__("ehb");
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BARRIER_H
+#define BARRIER_H
+
+/*
+ * Full barrier - ensure that writes to shared memory are visible to the other
+ * side before any subsequent read from shared memory.
+ */
+#ifdef __mips__
+#define mb()	__asm__ __volatile__("sync" : : :"memory")
+#else
+/* Hosted build of the common code, see sim/ */
+#define mb()	__sync_synchronize()
+#endif /* __mips__ */
+
+/*
+ * Write barrier - ensure that writes to shared memory (e.g. a used ring
+ * entry) are visible to the other side before any subsequent write
+ * (e.g. the used ring index).
+ */
+#ifdef __mips__
+#define wmb()							\
+do {								\
+	__asm__("ehb");						\
+	__asm__ __volatile__("sync" : : :"memory");		\
+} while (0)
+#else
+/* Hosted build of the common code, see sim/ */
+#define wmb()	__sync_synchronize()
+#endif /* __mips__ */
+
+/*
+ * Read barrier - ensure that a read from shared memory (e.g. a packed ring
+ * descriptors flags) completes before any subsequent read (e.g. the rest of
+ * the descriptor).
+ */
+#ifdef __mips__
+#define rmb()	__asm__ __volatile__("sync" : : :"memory")
+#else
+/* Hosted build of the common code, see sim/ */
+#define rmb()	__sync_synchronize()
+#endif /* __mips__ */
+
+#endif /* BARRIER_H */
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+
+/*
+ * Data cache maintenance, for sharing cached buffers with a kernel that
+ * doesn't keep them coherent (see DMA_COHERENT in the firmware). Ranges are
+ * KSEG0 (cached) addresses. Both the L1 data cache and, if there is one, the
+ * L2 cache are maintained. The hosted build (sim/) is coherent, so these do
+ * nothing there.
+ */
+
+/* Read the cache line sizes from CP0. Must be called before the others. */
+void cache_init(void);
+
+/*
+ * Discard any cached copy of a buffer the other side has written, before
+ * reading it. Lines only partly inside the range are written back rather
+ * than discarded, since the rest of them may hold data that isn't ours to
+ * lose.
+ */
+void dcache_inv_range(void *start, size_t len);
+
+/*
+ * Write back and discard a buffer written through the cache, before giving
+ * it to the other side. This completes before any later barrier (wmb()), so
+ * the buffer is in memory before the used ring entry that hands it back.
+ */
+void dcache_wback_inv_range(void *start, size_t len);
+
+#endif /* CACHE_H */
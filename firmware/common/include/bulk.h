@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _BULK_H_
+#define _BULK_H_
+
+#include <stdint.h>
+
+/*
+ * Bulk data carveout, shared between the firmware and user space on the Linux
+ * side. Linux allocates it (the carveout resource asks for FW_RSC_ADDR_ANY)
+ * and user space maps it, e.g. through /dev/mem or a UIO device, so that bulk
+ * data needn't be copied through virtio buffers by the kernel. The carveout
+ * holds a header, written by the firmware, followed by a ring of fixed size
+ * slots. Only descriptors naming a slot and a length are sent over a vring.
+ *
+ * This header is also used by the host library (host/case_invert/bulk-map.c),
+ * so the layout depends only on stdint.h.
+ */
+
+/* Written to the header once the firmware has laid out the carveout */
+#define BULK_MAGIC		0x4b4c5542	/* "BULK" */
+
+/* Offset of the first slot, leaving the header a page of its own */
+#define BULK_SLOT_OFFSET	0x1000
+
+/* Header at the start of the carveout */
+struct bulk_header {
+	uint32_t magic;			/* BULK_MAGIC */
+	uint32_t slot_size;		/* Bytes in each slot */
+	uint32_t num_slots;		/* Slots in the ring */
+	uint32_t slot_offset;		/* Offset of slot 0 from the header */
+};
+
+/* A slot, and the length of the data in it, as sent over the vring */
+struct bulk_desc {
+	uint32_t slot;
+	uint32_t len;
+};
+
+struct fw_rsc_carveout;
+
+/* Firmware view of the carveout */
+struct bulk {
+	uint32_t pa;			/* Physical address, from Linux */
+	uint32_t slot_size;
+	uint32_t num_slots;
+	long phys_offset;		/* Offset for the header, as for vrings */
+};
+
+/*
+ * Lay the carveout Linux has allocated for rsc out as slots of slot_size
+ * bytes, and write the header. Linux fills the carveout in before starting
+ * the firmware. The header is written at the offset given to
+ * bulk_set_phys_offset, which must be called first.
+ */
+void bulk_init(struct bulk *b, volatile struct fw_rsc_carveout *rsc,
+	       uint32_t slot_size);
+
+/*
+ * Set how the firmware accesses the header, as for vring_set_phys_offset. It
+ * is written without cache maintenance, so this must give an uncached address
+ * unless DMA is coherent.
+ */
+void bulk_set_phys_offset(struct bulk *b, long offset);
+
+/*
+ * Find the slot named by a descriptor, limiting its length to the slot size
+ * \return physical address of the slot, or NULL (with the length zeroed) if
+ * there is no such slot
+ */
+void *bulk_slot(struct bulk *b, struct bulk_desc *desc);
+
+#endif /* _BULK_H_ */
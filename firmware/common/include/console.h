@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _CONSOLE_H_
+#define _CONSOLE_H_
+
+#include <stdint.h>
+#include <vring.h>
+
+/*
+ * Virtio console (VIRTIO_ID_RPROC_SERIAL) with several ports. When Linux
+ * negotiates VIRTIO_CONSOLE_F_MULTIPORT, each port has its own pair of vrings,
+ * and ports are added and opened with messages on a pair of control vrings.
+ * The vrings of the vdev resource are then, in order: port 0 receive and
+ * transmit, control receive and transmit, then receive and transmit for each
+ * further port. Receive vrings carry data to Linux, transmit vrings data from
+ * it. Otherwise only port 0 exists, on the first pair.
+ */
+
+/* Feature bit: ports after port 0 and the control vrings exist */
+#define VIRTIO_CONSOLE_F_MULTIPORT	1
+
+/* Device config space, at the start of the vdevs config */
+struct virtio_console_config {
+	uint16_t cols;
+	uint16_t rows;
+	uint32_t max_nr_ports;		/* Including port 0 */
+	uint32_t emerg_wr;
+} __packed;
+
+/* Vrings in a vdev resource for ports, including the control vrings */
+#define CONSOLE_NUM_VRINGS(ports)	(2 * (ports) + 2)
+
+/* Message on the control vrings */
+struct virtio_console_control {
+	uint32_t id;			/* Port number */
+	uint16_t event;			/* VIRTIO_CONSOLE_* */
+	uint16_t value;
+} __packed;
+
+#define VIRTIO_CONSOLE_BAD_ID		(~(uint32_t)0)
+
+#define VIRTIO_CONSOLE_DEVICE_READY	0	/* Linux: control vrings ready */
+#define VIRTIO_CONSOLE_PORT_ADD		1	/* Us: port id exists */
+#define VIRTIO_CONSOLE_PORT_REMOVE	2
+#define VIRTIO_CONSOLE_PORT_READY	3	/* Linux: port id set up */
+#define VIRTIO_CONSOLE_CONSOLE_PORT	4
+#define VIRTIO_CONSOLE_RESIZE		5
+#define VIRTIO_CONSOLE_PORT_OPEN	6	/* Either: port id opened/closed */
+#define VIRTIO_CONSOLE_PORT_NAME	7	/* Us: name follows the message */
+
+struct console_port {
+	const char *name;		/* Name given to Linux, or NULL */
+	struct vring incoming;		/* Data from Linux (transmit vring) */
+	struct vring outgoing;		/* Buffers for data to Linux (receive) */
+	int active;			/* vrings set up */
+	int open;			/* Opened on the Linux side */
+
+	/* Control messages still to send */
+	int need_add, need_name, need_open;
+};
+
+struct console {
+	volatile struct fw_rsc_vdev *rsc; /* vdev resource */
+	void (*notify)(void);		/* Interrupt Linux */
+	struct console_port *ports;
+	int num_ports;
+	long phys_offset;		/* Physical to virtual address offset */
+
+	int started;			/* Linux driver is ready */
+	int multiport;			/* VIRTIO_CONSOLE_F_MULTIPORT negotiated */
+	int packed;			/* vrings use the packed layout */
+	struct vring ctrl_incoming;	/* Control messages from Linux */
+	struct vring ctrl_outgoing;	/* Buffers for control messages to Linux */
+};
+
+/*
+ * Initialise a console. The vrings are set up once Linux has set DRIVER_OK
+ * in the vdev resource.
+ * \param con		Console to initialise
+ * \param rsc		Resource table entry for the vdev, with
+ * 			CONSOLE_NUM_VRINGS(num_ports) vrings
+ * \param ports		Ports, numbered from 0
+ * \param num_ports	Number of ports, which must match max_nr_ports
+ * \param notify	Called to interrupt Linux
+ */
+void console_init(struct console *con, volatile struct fw_rsc_vdev *rsc,
+		  struct console_port *ports, int num_ports,
+		  void (*notify)(void));
+
+/*
+ * Lay the vrings out packed (VIRTIO_F_RING_PACKED), which is beyond the 32
+ * bits of features in a vdev resource, so can't be negotiated through it.
+ * Must be called before the console starts.
+ */
+void console_set_packed(struct console *con, int packed);
+
+/*
+ * Set how the firmware accesses memory Linux refers to by physical address,
+ * as vring_set_phys_offset. Control messages are accessed without cache
+ * maintenance, so this must give an uncached address unless DMA is coherent.
+ */
+void console_set_phys_offset(struct console *con, long offset);
+
+/*
+ * Start the console if Linux is ready, handle control messages from Linux,
+ * and send Linux any control messages that are due. Port data is left to
+ * the caller, on the vrings of each active port.
+ * \return number of control messages handled
+ */
+int console_handle_control(struct console *con);
+
+/*
+ * Ask Linux to notify us when it next sends control messages or data on any
+ * active port, as vring_enable_notify
+ * \return non-zero when messages or data are available
+ */
+int console_enable_notify(struct console *con);
+
+#endif /* _CONSOLE_H_ */
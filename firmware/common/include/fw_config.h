@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _FW_CONFIG_H_
+#define _FW_CONFIG_H_
+
+#include <stdint.h>
+
+/*
+ * Vendor configuration block, placed in the virtio config space of a vdev
+ * resource at FW_CONFIG_OFFSET, after the virtio_console_config the host
+ * driver may use. The firmware initialises it with its compiled in defaults,
+ * and the host may rewrite it at any time, e.g. with rproc-example-host -t,
+ * which maps the loaded resource table through /dev/mem (see
+ * host/case_invert/fw-config-map.c). The firmware re-reads it each time it is
+ * kicked, so a change takes effect from the next kick.
+ */
+struct fw_config {
+	uint8_t mode;		/* FW_MODE_* */
+	uint8_t flags;		/* FW_CONFIG_* */
+	uint8_t trace_level;	/* TRACE_LEVEL_* */
+	uint8_t reserved;
+	uint32_t poll_budget;	/* CP0 Count cycles to poll for in FW_MODE_HYBRID */
+};
+
+#define FW_CONFIG_OFFSET	0xc
+
+/* How incoming buffers are serviced */
+#define FW_MODE_INTERRUPT	0	/* Each kick raises an interrupt */
+#define FW_MODE_POLLED		1	/* Spin checking for kicks */
+#define FW_MODE_HYBRID		2	/* Poll after an interrupt until idle */
+
+/* The kernel accesses shared buffers cached, with coherent DMA */
+#define FW_CONFIG_DMA_COHERENT	(1 << 0)
+/* Access buffers cached, maintaining the cache, when DMA is not coherent */
+#define FW_CONFIG_DMA_CACHE_OPS	(1 << 1)
+
+#endif /* _FW_CONFIG_H_ */
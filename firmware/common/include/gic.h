@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _GIC_H_
+#define _GIC_H_
+
+#include <stdint.h>
+
+/*
+ * MIPS Global Interrupt Controller, for the IPIs between Linux and the
+ * firmware. Each IPI is a GIC shared interrupt, and the register addresses
+ * and bit for one are worked out once by gic_irq_init, so that checking or
+ * raising it is a single load or store.
+ */
+
+/* Linux numbers the shared interrupts after the local ones */
+#define GIC_LOCAL_INTERRUPTS	7
+
+/* Offset of the GIC_BASE register in the CM global control registers */
+#define GCR_GIC_BASE		0x0080
+
+/* Shared section registers, each an array with a bit per interrupt */
+#define GIC_SH_WEDGE		0x0280
+#define GIC_SH_RMASK		0x0300
+#define GIC_SH_SMASK		0x0380
+#define GIC_SH_PEND		0x0480
+
+/* Set in a write to GIC_SH_WEDGE to assert the interrupt, clear to deassert */
+#define GIC_SH_WEDGE_SET	(1 << 31)
+
+/* Local section registers, for this VPE */
+#define GIC_VPE_LOCAL		0x8000
+#define GIC_VPE_RMASK		0x000c
+#define GIC_VPE_RMASK_ALL	0x7f
+
+/* A shared interrupt */
+struct gic_irq {
+	int irq;			/* Shared interrupt number */
+	uint32_t bit;			/* Its bit in the pending and mask registers */
+	volatile uint32_t *pend;
+	volatile uint32_t *smask;
+	volatile uint32_t *rmask;
+	volatile uint32_t *wedge;
+};
+
+/* A pair of IPIs, one from Linux to the firmware and one back */
+struct gic_ipi {
+	struct gic_irq from_host;
+	struct gic_irq to_host;
+};
+
+/*
+ * Find the GIC from the CM, whose base is read from CP0 CMGCRBase, and mask
+ * all local interrupts (such as the timer) that Linux may have left unmasked
+ */
+void gic_init(void);
+
+/* Work out the registers of shared interrupt irq, once gic_init has run */
+void gic_irq_init(struct gic_irq *irq, int num);
+
+/*
+ * Set up a pair of IPIs from the interrupt numbers Linux gives the firmware,
+ * which count the local interrupts. Linux passes one pair in a1 and a2, and
+ * a firmware may set up more for other channels if it can agree their numbers
+ * with the host.
+ */
+void gic_ipi_init(struct gic_ipi *ipi, int irq_from_host, int irq_to_host);
+
+/* Mask or unmask a shared interrupt */
+void gic_irq_mask(struct gic_irq *irq);
+void gic_irq_unmask(struct gic_irq *irq);
+
+/* Enable or disable the GIC interrupt (IM2) to this CPU, with IE */
+void gic_cpu_irq_enable(void);
+void gic_cpu_irq_disable(void);
+
+/*
+ * Check whether an interrupt is pending, and clear it if so
+ * \return non-zero if it was pending
+ */
+static inline int gic_irq_ack(struct gic_irq *irq)
+{
+	if (!(*irq->pend & irq->bit))
+		return 0;
+
+	*irq->wedge = irq->irq;
+	return 1;
+}
+
+/* Assert an interrupt */
+static inline void gic_irq_raise(struct gic_irq *irq)
+{
+	*irq->wedge = GIC_SH_WEDGE_SET | irq->irq;
+}
+
+#endif /* _GIC_H_ */
@@ -43,6 +43,15 @@
 /* Platform must supply this function to output a character */
 int putchar(char c);
 
+/*
+ * Platform may supply this function to output a run of len characters at
+ * once, otherwise each character is passed to putchar
+ */
+void printf_write(const char *s, int len);
+
+int simple_printf(char *fmt, ...);
+int simple_sprintf(char *buf, char *fmt, ...);
+
 #define printf simple_printf
 #define sprintf simple_sprintf
 
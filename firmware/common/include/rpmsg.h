@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _RPMSG_H_
+#define _RPMSG_H_
+
+#include <stdint.h>
+#include <vring.h>
+
+/*
+ * rpmsg bus over a virtio device (VIRTIO_ID_RPMSG) with one pair of vrings.
+ * Every message carries a source and destination address, so any number of
+ * endpoints in the firmware can share the pair. Messages to the firmware are
+ * dispatched to the callback of the endpoint with the destination address,
+ * from a table the firmware provides. Endpoints with a name are announced to
+ * the Linux name service, which creates an rpmsg device for each one that a
+ * driver (e.g. rpmsg_char) can bind to.
+ */
+
+/* Virtio device ID of an rpmsg bus */
+#define VIRTIO_ID_RPMSG		7
+
+/* Feature bit: the firmware announces its endpoints to the name service */
+#define VIRTIO_RPMSG_F_NS	0
+
+/* Address of the name service endpoint in Linux */
+#define RPMSG_NS_ADDR		53
+
+/* Addresses below this are reserved for predefined services */
+#define RPMSG_RESERVED_ADDRESSES 1024
+
+/* Size of the buffers Linux allocates, including the header */
+#define RPMSG_BUF_SIZE		512
+
+/* Header at the start of every message */
+struct rpmsg_hdr {
+	uint32_t src;			/* Senders address */
+	uint32_t dst;			/* Recipients address */
+	uint32_t reserved;
+	uint16_t len;			/* Length of data following */
+	uint16_t flags;
+	uint8_t data[];
+} __packed;
+
+#define RPMSG_NAME_SIZE		32
+
+/* Name service announcement, sent to RPMSG_NS_ADDR */
+struct rpmsg_ns_msg {
+	char name[RPMSG_NAME_SIZE];
+	uint32_t addr;
+	uint32_t flags;			/* RPMSG_NS_* */
+} __packed;
+
+#define RPMSG_NS_CREATE		0
+#define RPMSG_NS_DESTROY	1
+
+struct rpmsg_device;
+struct rpmsg_endpoint;
+
+/*
+ * Called for each message to an endpoint. It may reply with rpmsg_send,
+ * which is published along with the rest of the batch.
+ * \param rdev	Device the message arrived on
+ * \param ept	Endpoint the message is addressed to
+ * \param data	Message data, which must not be written
+ * \param len	Length of the data
+ * \param src	Senders address, to reply to
+ */
+typedef void (*rpmsg_cb_t)(struct rpmsg_device *rdev, struct rpmsg_endpoint *ept,
+			   const void *data, int len, uint32_t src);
+
+struct rpmsg_endpoint {
+	const char *name;		/* Announced to Linux, or NULL */
+	uint32_t addr;			/* Local address */
+	rpmsg_cb_t cb;
+	void *priv;
+};
+
+struct rpmsg_device {
+	volatile struct fw_rsc_vdev *rsc; /* vdev resource, with 2 vrings */
+	void (*notify)(void);		/* Interrupt Linux */
+	struct rpmsg_endpoint *endpoints; /* Dispatch table */
+	int num_endpoints;
+	long phys_offset;		/* Physical to virtual address offset */
+
+	int started;			/* Linux driver is ready */
+	struct vring incoming;		/* Messages from Linux (vring 1) */
+	struct vring outgoing;		/* Buffers for messages to Linux (vring 0) */
+	int ns;				/* VIRTIO_RPMSG_F_NS negotiated */
+	int announced;			/* Endpoints announced so far */
+	int tx_head;			/* Buffer from rpmsg_get_tx_buffer */
+	struct rpmsg_hdr *tx_hdr;
+	unsigned long dropped;		/* Messages to unknown addresses */
+};
+
+/*
+ * Initialise an rpmsg device. The vrings are set up once Linux has set
+ * DRIVER_OK in the vdev resource, which may be after the firmware has started
+ * when there are several vdevs.
+ * \param rdev		Device to initialise
+ * \param rsc		Resource table entry for the vdev
+ * \param endpoints	Dispatch table of the firmware endpoints
+ * \param num_endpoints	Number of entries in endpoints
+ * \param notify	Called to interrupt Linux
+ */
+void rpmsg_init(struct rpmsg_device *rdev, volatile struct fw_rsc_vdev *rsc,
+		struct rpmsg_endpoint *endpoints, int num_endpoints,
+		void (*notify)(void));
+
+/*
+ * Set how the firmware accesses the message buffers, as for
+ * vring_set_phys_offset. Buffers are accessed without cache maintenance, so
+ * this must give an uncached address unless DMA is coherent.
+ */
+void rpmsg_set_phys_offset(struct rpmsg_device *rdev, long offset);
+
+/*
+ * Handle all messages Linux has sent, dispatching each to its endpoint, and
+ * announce any endpoints not yet announced. Replies are published with the
+ * batch, and Linux interrupted if it wants to be.
+ * \return number of messages handled
+ */
+int rpmsg_handle_incoming(struct rpmsg_device *rdev);
+
+/*
+ * Ask Linux to notify us when it next sends a message, as vring_enable_notify
+ * \return non-zero when messages are available
+ */
+int rpmsg_enable_notify(struct rpmsg_device *rdev);
+
+/*
+ * Send a message to Linux. Outside of an endpoint callback, the message is
+ * only staged until rpmsg_flush is called.
+ * \param rdev	Device to send on
+ * \param src	Local endpoint address
+ * \param dst	Remote address
+ * \param data	Message data
+ * \param len	Length of the data
+ * \return 0 on success, or -1 if Linux has no buffer free or len is too long
+ */
+int rpmsg_send(struct rpmsg_device *rdev, uint32_t src, uint32_t dst,
+	       const void *data, int len);
+
+/*
+ * Get a buffer to build a message to Linux in, rather than having rpmsg_send
+ * copy it. Only one buffer may be held at a time, and it must be sent with
+ * rpmsg_send_nocopy before calling rpmsg_send.
+ * \param rdev	Device to send on
+ * \param len	Contents will be updated with the space for data
+ * \return pointer to the data area of the message, or NULL if Linux has no
+ *         buffer free
+ */
+void *rpmsg_get_tx_buffer(struct rpmsg_device *rdev, int *len);
+
+/*
+ * Send the message built in the buffer from rpmsg_get_tx_buffer, as
+ * rpmsg_send
+ * \param len	Length of the data written
+ */
+int rpmsg_send_nocopy(struct rpmsg_device *rdev, uint32_t src, uint32_t dst,
+		      int len);
+
+/*
+ * Publish messages staged by rpmsg_send, interrupting Linux if it wants to be
+ */
+void rpmsg_flush(struct rpmsg_device *rdev);
+
+#endif /* _RPMSG_H_ */
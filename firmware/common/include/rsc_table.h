@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _RSC_TABLE_H_
+#define _RSC_TABLE_H_
+
+#include <asm/remoteproc.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Descriptors in each vring. Linux allocates the vrings with the depth given
+ * in the resource table, so it is chosen when the firmware is built, e.g.
+ * make vring_num=64. The split ring is indexed with a mask, so it must be a
+ * power of 2.
+ */
+#ifndef VRING_NUM
+#define VRING_NUM		16
+#endif
+
+#define VRING_ALIGN		0x1000
+
+_Static_assert(VRING_NUM > 0 && !(VRING_NUM & (VRING_NUM - 1)),
+	       "VRING_NUM must be a power of 2");
+
+/* Resource entry types, each a resource header and its body */
+#define RSC_CARVEOUT_ENTRY						\
+	struct {							\
+		struct fw_rsc_hdr		header;			\
+		struct fw_rsc_carveout		carveout;		\
+	}
+
+#define RSC_TRACE_ENTRY							\
+	struct {							\
+		struct fw_rsc_hdr		header;			\
+		struct fw_rsc_trace		trace;			\
+	}
+
+/* A vdev with nvrings vrings, then its config space given as members */
+#define RSC_VDEV_ENTRY(nvrings, config...)				\
+	struct {							\
+		struct fw_rsc_hdr		header;			\
+		struct fw_rsc_vdev		vdev;			\
+		struct fw_rsc_vdev_vring	vring[nvrings];		\
+		config							\
+	}
+
+/* Initialisers for the entries above */
+#define RSC_CARVEOUT_INIT(_da, _len, _name)				\
+	{								\
+		.header = {						\
+			.type = RSC_CARVEOUT,				\
+		},							\
+		.carveout = {						\
+			.da = (_da),					\
+			.pa = (_da),					\
+			.len = (_len),					\
+			.name = _name,					\
+		},							\
+	}
+
+#define RSC_TRACE_INIT(_da, _len, _name)				\
+	{								\
+		.header = {						\
+			.type = RSC_TRACE,				\
+		},							\
+		.trace = {						\
+			.da = (_da),					\
+			.len = (_len),					\
+			.name = _name,					\
+		},							\
+	}
+
+#define RSC_VDEV_HEADER							\
+	.header = {							\
+		.type = RSC_VDEV,					\
+	}
+
+/*
+ * The vring count of vdev resource name, from the size of its vring array,
+ * for the num_of_vrings member of its fw_rsc_vdev:
+ *
+ *	.vdev = {
+ *		RSC_VDEV_HEADER,
+ *		.vdev = {
+ *			RSC_VDEV_NUM_VRINGS(vdev),
+ *			...
+ */
+#define RSC_VDEV_NUM_VRINGS(name)					\
+	.num_of_vrings = sizeof(resource_table.name.vring) /		\
+			 sizeof(resource_table.name.vring[0])
+
+/* A vring of the configured depth, with a placeholder notify ID */
+#define RSC_VRING(_notifyid)						\
+	{								\
+		.align = VRING_ALIGN,					\
+		.num = VRING_NUM,					\
+		.notifyid = (_notifyid),				\
+	}
+
+/*
+ * Declare the resource table from a list of resources, so that the number
+ * of entries and their offsets are worked out by the compiler. The list is a
+ * macro taking another macro, R, which it applies to the name and entry type
+ * of each resource in turn:
+ *
+ *	#define RESOURCES(R)					\
+ *		R(carveout, RSC_CARVEOUT_ENTRY)			\
+ *		R(trace, RSC_TRACE_ENTRY)
+ *
+ *	RESOURCE_TABLE(RESOURCES) = {
+ *		RSC_TABLE_HEADER(RESOURCES),
+ *		.carveout = RSC_CARVEOUT_INIT(...),
+ *		.trace = RSC_TRACE_INIT(...),
+ *	};
+ *
+ * This defines struct __resource_table, and the table itself, resource_table,
+ * in the ".resource_table" section where the remoteproc core finds it. Each
+ * resource is a member named as in the list.
+ */
+#define RSC_TABLE_COUNT(name, type)	+ 1
+#define RSC_TABLE_MEMBER(name, type)	type name;
+#define RSC_TABLE_OFFSET(name, type)	offsetof(struct __resource_table, name),
+
+#define RSC_TABLE_NUM(list)		(0 list(RSC_TABLE_COUNT))
+
+#define RESOURCE_TABLE(list)						\
+	struct __resource_table {					\
+		struct resource_table		header;			\
+		uint32_t			offset[RSC_TABLE_NUM(list)]; \
+		list(RSC_TABLE_MEMBER)					\
+	} volatile resource_table __attribute__ ((section (".resource_table")))
+
+#define RSC_TABLE_HEADER(list)						\
+	.header = {							\
+		.ver = 1,						\
+		.num = RSC_TABLE_NUM(list),				\
+	},								\
+	.offset = {							\
+		list(RSC_TABLE_OFFSET)					\
+	}
+
+#endif /* _RSC_TABLE_H_ */
@@ -44,17 +44,99 @@
 /*
  * Trace buffer - we can write this and read it from the host via
  * cat /sys/kernel/debug/remoteproc/remoteproc0/trace0
+ *
+ * The buffer starts with a header, followed by a ring of TRACE_DATA_SIZE
+ * bytes which is written continuously. The header holds the size of the
+ * ring, the position the next byte will be written at and the number of
+ * times the position has wrapped, so the host can find the oldest data and
+ * tail the buffer without losing or repeating any (see host/trace-decode).
+ *
+ * Each number in the header is a fixed number of bytes of 0x80 | 7 bits,
+ * least significant first, so that no byte of the header is 0 - Linux stops
+ * reading the buffer at the first NUL.
+ *
+ * The sequence number is odd while the position and wrap count are being
+ * updated. A reader that sees it odd, or that doesn't read the same header
+ * twice running, must read the header again.
  */
 extern char trace_buf[];
 
+#define TRACE_HDR_MAGIC		0	/* "TRC" */
+#define TRACE_HDR_SIZE		3	/* 3 bytes, size of the ring */
+#define TRACE_HDR_POSITION	6	/* 3 bytes, next write position */
+#define TRACE_HDR_WRAP		9	/* 4 bytes, times the ring has wrapped */
+#define TRACE_HDR_SEQ		13	/* 1 byte, sequence number of updates */
+#define TRACE_HEADER_SIZE	15	/* Ends with a newline */
+
+#define TRACE_DATA_SIZE		(TRACE_BUFFER_SIZE - TRACE_HEADER_SIZE)
+
 /*
- * Clear the trace buffer
+ * What is written to the trace buffer. The firmware may change trace_level at
+ * run time, e.g. from its configuration block (see fw_config.h).
  */
-void trace_clear(void);
+#define TRACE_LEVEL_NONE	0	/* Nothing */
+#define TRACE_LEVEL_PRINTF	1	/* printf() text only */
+#define TRACE_LEVEL_ALL		2	/* printf() text and TRACE records */
+
+extern int trace_level;
 
 /*
  * Function to print a character into the trace buffer
  */
 void trace_putc(char c);
 
+/*
+ * Function to print len characters into the trace buffer, publishing the
+ * new position once at the end
+ */
+void trace_puts(const char *s, int len);
+
+/*
+ * Binary trace records
+ *
+ * TRACE(fmt, ...) records the position of fmt in the trace_fmt section, a
+ * timestamp (CP0 Count) and up to TRACE_MAX_ARGS arguments in the trace
+ * buffer, rather than formatting them. The format strings are only read by
+ * the host decoder, from the firmware ELF (see host/trace-decode), so they
+ * cost nothing at run time and need not be loaded.
+ *
+ * Arguments are converted to long, so pointers must be cast. %s can't be
+ * decoded, since the host can't follow the pointer.
+ *
+ * A record is TRACE_RECORD_START followed by values, each encoded as bytes of
+ * 0x80 | 7 bits, least significant first, and a final byte of 0x40 | 6 bits.
+ * The values are (format offset * 8 + argument count), the timestamp and the
+ * arguments. No byte is 0, so the debugfs trace file (which stops at a NUL)
+ * reads the whole buffer, and records can be mixed with printf text.
+ *
+ * Nothing is recorded, and the arguments are not evaluated, unless
+ * trace_level is TRACE_LEVEL_ALL.
+ */
+#define TRACE_RECORD_START	0x1e
+#define TRACE_MAX_ARGS		7
+
+extern const char __start_trace_fmt[];
+
+#define TRACE(fmt, ...)							\
+do {									\
+	static const char __trace_fmt[]					\
+		__attribute__ ((section ("trace_fmt"))) = fmt;		\
+									\
+	if (trace_level >= TRACE_LEVEL_ALL) {				\
+		const long __trace_args[] = { 0, ##__VA_ARGS__ };	\
+									\
+		trace_record(__trace_fmt - __start_trace_fmt,		\
+			     __trace_args + 1,				\
+			     sizeof(__trace_args) / sizeof(long) - 1);	\
+	}								\
+} while (0)
+
+/*
+ * Write a binary trace record, see TRACE
+ * \param id	Offset of the format string in the trace_fmt section
+ * \param args	Arguments
+ * \param nargs	Number of arguments, at most TRACE_MAX_ARGS
+ */
+void trace_record(unsigned long id, const long *args, int nargs);
+
 #endif /* _TRACE_H_ */
\ No newline at end of file
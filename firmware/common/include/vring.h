@@ -43,6 +43,56 @@
 
 #include <asm/remoteproc.h>
 
+/* The buffer continues in the descriptor indexed by the next member */
+#define VRING_DESC_F_NEXT		1
+
+/* The buffer is write only for the firmware (otherwise read only) */
+#define VRING_DESC_F_WRITE		2
+
+/* The buffer is a table of descriptors (address and length of the table) */
+#define VRING_DESC_F_INDIRECT		4
+
+/* The host does not need an interrupt when buffers are used */
+#define VRING_AVAIL_F_NO_INTERRUPT	1
+
+/* The firmware does not need a kick when buffers are made available */
+#define VRING_USED_F_NO_NOTIFY		1
+
+/* vdev status bit set by the host once its driver is ready */
+#define VIRTIO_CONFIG_S_DRIVER_OK	4
+
+/* Feature bit: descriptors may have the VRING_DESC_F_INDIRECT flag */
+#define VIRTIO_RING_F_INDIRECT_DESC	28
+
+/*
+ * Feature bit: the used_event / avail_event indexes following the avail and
+ * used rings set the point at which the other side wants to be notified
+ */
+#define VIRTIO_RING_F_EVENT_IDX		29
+
+/*
+ * Feature bit: the vrings use the packed layout (virtio 1.1). This is beyond
+ * the 32 feature bits of a fw_rsc_vdev, so remoteproc can't negotiate it -
+ * the layout of each vring is chosen by vring_init_packed instead.
+ */
+#define VIRTIO_F_RING_PACKED		34
+
+/*
+ * Packed descriptor flag bits (shifts, as in Linux). A descriptor is available
+ * when AVAIL matches the drivers wrap counter and USED does not, and used when
+ * both match the devices wrap counter.
+ */
+#define VRING_PACKED_DESC_F_AVAIL	7
+#define VRING_PACKED_DESC_F_USED	15
+
+/* Packed ring event suppression flags */
+#define VRING_PACKED_EVENT_FLAG_ENABLE	0
+#define VRING_PACKED_EVENT_FLAG_DISABLE	1
+#define VRING_PACKED_EVENT_FLAG_DESC	2	/* Notify at off_wrap */
+
+/* Wrap counter bit of off_wrap */
+#define VRING_PACKED_EVENT_F_WRAP_CTR	15
+
 /* Virtio ring descriptor */
 struct vring_desc {
 	uint64_t address;		/* Physical address of buffer */
@@ -71,16 +121,68 @@ struct vring_used {
 	struct vring_used_entry ring[];
 } __packed;
 
+/*
+ * Packed virtqueue descriptor. Both sides share the one ring - the host makes
+ * descriptors available in it and the firmware overwrites them as used.
+ */
+struct vring_packed_desc {
+	uint64_t address;		/* Physical address of buffer */
+	uint32_t length;		/* Length of buffer (or used length) */
+	uint16_t id;			/* Buffer ID */
+	uint16_t flags;
+};
+
+/* Packed virtqueue event suppression */
+struct vring_packed_event {
+	uint16_t off_wrap;		/* Descriptor offset and wrap counter */
+	uint16_t flags;			/* VRING_PACKED_EVENT_FLAG_* */
+};
+
 struct vring {
 	unsigned int num_descriptors;
 	uint16_t avail_index;		/* Local shadow of available ring index */
 	uint16_t used_index;		/* Local shadow of used ring index */
+	uint16_t used_staged;		/* Used entries not yet published */
 
 	struct vring_desc *desc;	/* ring descriptor array */
 
 	struct vring_avail *avail;	/* Pointer to available ring */
 
 	struct vring_used *used;	/* Pointer to used ring */
+
+	int event_idx;			/* VIRTIO_RING_F_EVENT_IDX negotiated */
+	uint16_t signalled_used;	/* Used index when host last notified */
+	volatile uint16_t *used_event;	/* Host: notify me at this used index */
+	volatile uint16_t *avail_event;	/* Us: notify me at this avail index */
+
+	long phys_offset;		/* Physical to virtual address offset */
+
+	/*
+	 * Packed layout. avail_index and used_index are then positions in the
+	 * descriptor ring rather than free running indexes.
+	 */
+	int packed;
+	struct vring_packed_desc *packed_desc;	/* Descriptor ring */
+	volatile struct vring_packed_event *driver_event; /* Host: notify me */
+	volatile struct vring_packed_event *device_event; /* Us: notify me */
+	uint16_t avail_wrap;		/* Wrap counter for avail_index */
+	uint16_t used_wrap;		/* Wrap counter for used_index */
+	uint16_t used_added;		/* Descriptors used since notifying host */
+	uint16_t batch_index;		/* First descriptor staged as used */
+	uint16_t batch_flags;		/* Its flags, written when published */
+};
+
+
+/* Iterator over the chain of descriptors making up one buffer */
+struct vring_iter {
+	void *table;			/* Descriptor table being walked */
+	int packed;			/* Table holds struct vring_packed_desc */
+	unsigned int table_size;	/* Number of descriptors in table */
+	int next;			/* Next descriptor, or -1 at end of chain */
+	int indirect;			/* Walking an indirect table */
+	long phys_offset;		/* Physical to virtual address offset */
+	unsigned int count;		/* Descriptors visited */
+	unsigned int length;		/* Total length of descriptors visited */
 };
 
 
@@ -91,6 +193,32 @@ struct vring {
  */
 void vring_init(struct vring *vring, volatile struct fw_rsc_vdev_vring *rsc);
 
+/*
+ * Initialise a struct vring with the packed layout from the provided fw
+ * resource. The descriptor ring is at the resources da, immediately followed
+ * by the driver and then the device event suppression structures.
+ * Buffers must be returned to a packed vring in the order they were retrieved.
+ * \param vring	vring to initialise
+ * \param rsc	resource table entry for the vring
+ */
+void vring_init_packed(struct vring *vring, volatile struct fw_rsc_vdev_vring *rsc);
+
+/*
+ * Apply the features negotiated with the host
+ * \param vring	vring to configure
+ * \param features	gfeatures from the vdev resource table entry
+ */
+void vring_set_features(struct vring *vring, uint32_t features);
+
+/*
+ * Set how the firmware accesses memory the host refers to by physical
+ * address, such as indirect descriptor tables.
+ * \param vring	vring to configure
+ * \param offset	Added to a physical address to give a virtual address,
+ * 		e.g. of KSEG0 or KSEG1
+ */
+void vring_set_phys_offset(struct vring *vring, long offset);
+
 /*
  * Print the vring state
  */
@@ -98,28 +226,126 @@ void vring_print(struct vring *vring);
 
 /*
  * Get the next available buffer from the vring.
+ * Only the first descriptor of a chain is returned (see vring_get_chain).
  * The vrings available index is incremented so this buffer
  * will not be returned again. The buffer must subsequently
- * be returned to the host via the used ring (vring_put_buffer)
+ * be returned to the host via the used ring (vring_put_buffer_head)
  * \param vring	ring containing buffer
  * \param buf	Contents will be updated with the pointer to the buffer
  * \param len	Contents will be updated with the buffer length
+ * \return index of the buffers head descriptor (its buffer ID on a packed
+ *         vring), which identifies the buffer when it is returned, or -1 if
+ *         no buffer.
+ */
+int vring_get_buffer_head(struct vring *vring, void **buf, int *len);
+
+/*
+ * Get the next available buffer from the vring, which may be made up of a
+ * chain of descriptors. As vring_get_buffer_head, but rather than the first
+ * descriptor, an iterator over the whole chain is returned.
+ * \param vring	ring containing buffer
+ * \param iter	Iterator to initialise at the start of the chain
+ * \return index of the buffers head descriptor, or -1 if no buffer.
+ */
+int vring_get_chain(struct vring *vring, struct vring_iter *iter);
+
+/*
+ * Get the next segment of a chain of descriptors (vring_get_chain)
+ * A descriptor with VRING_DESC_F_INDIRECT is followed into the table of
+ * descriptors it refers to, which then provides the remaining segments.
+ * \param iter	Iterator over the chain
+ * \param buf	Contents will be updated with the pointer to the segment
+ * \param len	Contents will be updated with the segment length
+ * \param flags	If non-NULL, contents will be updated with the descriptor
+ * 		flags (e.g. VRING_DESC_F_WRITE)
+ * \return non-zero when a segment is returned or 0 at the end of the chain.
+ */
+int vring_iter_next(struct vring_iter *iter, void **buf, int *len, int *flags);
+
+/*
+ * Walk the remainder of a chain of descriptors
+ * \param iter	Iterator over the chain
+ * \return total length of every segment in the chain, suitable for
+ *         returning the buffer to the used ring.
+ */
+int vring_iter_finish(struct vring_iter *iter);
+
+/*
+ * As vring_get_buffer_head, for callers which return the buffer by address
+ * (vring_put_buffer)
  * \return non-zero when buffer is available and returned or 0 if no buffer.
  */
 int vring_get_buffer(struct vring *vring, void **buf, int *len);
 
 /*
- * Put a previously retrieved buffer (vring_get_buffer) onto the used ring
- * The buffer is found in the vring buffer descriptors and the next entry
- * in the used ring updated to that descriptor index.
- * The vrings used index is then incremented.
+ * Put a previously retrieved buffer (vring_get_buffer_head) onto the used ring
+ * The next entry in the used ring is updated to the head descriptor index.
+ * The vrings used index is then incremented, publishing this buffer and any
+ * previously staged by vring_stage_buffer_head.
  * \param vring	ring containing buffer
- * \param buf	Pointer to the buffer
+ * \param head	Head descriptor index returned by vring_get_buffer_head
  * \param len	Length of the buffer being returned. Note that in the case of
  * 		outgoing buffers where the host has provided memory to be written,
  * 		the length will be the amount of data actually written.
  * \return non-zero when buffer has been returned or 0 on error.
  */
+int vring_put_buffer_head(struct vring *vring, int head, int len);
+
+/*
+ * Stage a previously retrieved buffer (vring_get_buffer_head) in the used ring
+ * The next entry in the used ring is updated to the head descriptor index,
+ * but the host will not see it until vring_publish_used is called. This
+ * allows a batch of buffers to be returned with a single barrier and used
+ * index update.
+ * \param vring	ring containing buffer
+ * \param head	Head descriptor index returned by vring_get_buffer_head
+ * \param len	Length of the buffer being returned
+ * \return non-zero when buffer has been staged or 0 on error, including a
+ *         buffer returned out of order to a packed vring.
+ */
+int vring_stage_buffer_head(struct vring *vring, int head, int len);
+
+/*
+ * Make all buffers staged by vring_stage_buffer_head visible to the host
+ * by updating the used ring index.
+ * \param vring	ring containing staged buffers
+ */
+void vring_publish_used(struct vring *vring);
+
+/*
+ * Check whether the host has made a buffer available, without touching the
+ * notification state of the vring
+ * \param vring	ring to check
+ * \return non-zero when buffers are available
+ */
+int vring_has_available(struct vring *vring);
+
+/*
+ * Ask the host to notify us when it next makes a buffer available, and check
+ * whether it has done so while we weren't asking. If this returns non-zero,
+ * more buffers must be retrieved as the host may not notify us about them.
+ * \param vring	ring to enable notifications on
+ * \return non-zero when buffers are available
+ */
+int vring_enable_notify(struct vring *vring);
+
+/*
+ * Determine whether the host needs to be notified about buffers published
+ * to the used ring since the last time this returned
+ * \param vring	ring buffers have been published on
+ * \return non-zero if the host should be notified
+ */
+int vring_need_notify(struct vring *vring);
+
+/*
+ * Put a previously retrieved buffer (vring_get_buffer) onto the used ring
+ * The buffer is found in the vring buffer descriptors, which costs a search
+ * of the whole descriptor table, and then returned as vring_put_buffer_head.
+ * \param vring	ring containing buffer
+ * \param buf	Pointer to the buffer
+ * \param len	Length of the buffer being returned
+ * \return non-zero when buffer has been returned or 0 on error.
+ */
 int vring_put_buffer(struct vring *vring, void *buf, int len);
 
 #endif /* _VRING_H_ */
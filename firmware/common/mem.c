@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <mem.h>
+#include <stdint.h>
+
+/*
+ * The firmware is built with -fno-tree-loop-distribute-patterns for this
+ * file (see the Makefiles), so that gcc doesn't turn the loops below back
+ * into calls to memcpy and memset.
+ */
+
+/* interAptiv L1 data cache line */
+#define CACHE_LINE	32
+#define LINE_WORDS	(CACHE_LINE / 4)
+
+/* How far ahead of the copy to prefetch */
+#define PREFETCH_AHEAD	(4 * CACHE_LINE)
+
+#ifdef __mips__
+/* pref hints 0 (load) and 1 (store) */
+#define prefetch_load(p)	__asm__ __volatile__("pref 0, 0(%0)" : : "r" (p))
+#define prefetch_store(p)	__asm__ __volatile__("pref 1, 0(%0)" : : "r" (p))
+#else
+#define prefetch_load(p)	__builtin_prefetch(p, 0)
+#define prefetch_store(p)	__builtin_prefetch(p, 1)
+#endif /* __mips__ */
+
+/* Words of byte buffers, which gcc mustn't assume don't alias other types */
+typedef uint32_t word_t __attribute__ ((may_alias));
+
+/* A word which may be at any alignment, which gcc loads with lwl/lwr */
+struct unaligned_word {
+	word_t w;
+} __attribute__ ((packed));
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+	uint8_t *d = dst;
+	const uint8_t *s = src;
+	word_t *dw;
+
+	/* Bytes up to a word boundary in the destination */
+	for (; n && ((uintptr_t)d & 3); n--)
+		*d++ = *s++;
+
+	dw = (word_t *)d;
+	if (!((uintptr_t)s & 3)) {
+		const word_t *sw = (const word_t *)s;
+
+		/*
+		 * A cache line at a time, loading all of its words before
+		 * storing any, and prefetching the lines a few ahead of both
+		 * buffers while they are still within them
+		 */
+		for (; n >= CACHE_LINE; n -= CACHE_LINE) {
+			word_t w0, w1, w2, w3, w4, w5, w6, w7;
+
+			if (n >= CACHE_LINE + PREFETCH_AHEAD) {
+				prefetch_load((const uint8_t *)sw + PREFETCH_AHEAD);
+				prefetch_store((uint8_t *)dw + PREFETCH_AHEAD);
+			}
+
+			w0 = sw[0]; w1 = sw[1]; w2 = sw[2]; w3 = sw[3];
+			w4 = sw[4]; w5 = sw[5]; w6 = sw[6]; w7 = sw[7];
+			dw[0] = w0; dw[1] = w1; dw[2] = w2; dw[3] = w3;
+			dw[4] = w4; dw[5] = w5; dw[6] = w6; dw[7] = w7;
+			sw += LINE_WORDS;
+			dw += LINE_WORDS;
+		}
+		for (; n >= 4; n -= 4)
+			*dw++ = *sw++;
+		s = (const uint8_t *)sw;
+	} else {
+		const struct unaligned_word *sw = (const struct unaligned_word *)s;
+
+		for (; n >= CACHE_LINE; n -= CACHE_LINE) {
+			int i;
+
+			if (n >= CACHE_LINE + PREFETCH_AHEAD) {
+				prefetch_load((const uint8_t *)sw + PREFETCH_AHEAD);
+				prefetch_store((uint8_t *)dw + PREFETCH_AHEAD);
+			}
+
+			for (i = 0; i < LINE_WORDS; i++)
+				*dw++ = (sw++)->w;
+		}
+		for (; n >= 4; n -= 4)
+			*dw++ = (sw++)->w;
+		s = (const uint8_t *)sw;
+	}
+
+	/* And any bytes left over */
+	for (d = (uint8_t *)dw; n; n--)
+		*d++ = *s++;
+
+	return dst;
+}
+
+void *memset(void *dst, int c, size_t n)
+{
+	uint8_t *d = dst;
+	word_t w = (uint8_t)c * 0x01010101;
+	word_t *dw;
+
+	for (; n && ((uintptr_t)d & 3); n--)
+		*d++ = c;
+
+	dw = (word_t *)d;
+	for (; n >= CACHE_LINE; n -= CACHE_LINE) {
+		if (n >= CACHE_LINE + PREFETCH_AHEAD)
+			prefetch_store((uint8_t *)dw + PREFETCH_AHEAD);
+
+		dw[0] = w; dw[1] = w; dw[2] = w; dw[3] = w;
+		dw[4] = w; dw[5] = w; dw[6] = w; dw[7] = w;
+		dw += LINE_WORDS;
+	}
+	for (; n >= 4; n -= 4)
+		*dw++ = w;
+
+	for (d = (uint8_t *)dw; n; n--)
+		*d++ = c;
+
+	return dst;
+}
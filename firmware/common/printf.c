@@ -41,16 +41,62 @@
 
 #ifdef TEST
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+void printf_write(const char *s, int len);
+#else
+#include <printf.h>
 #endif /* TEST */
 
-static void simple_outputchar(char **str, char c)
+/*
+ * Output is gathered into runs of up to PRINT_RUN_LEN characters, which are
+ * passed to printf_write together, or written straight to the sprintf buffer.
+ */
+#define PRINT_RUN_LEN 64
+
+struct sink {
+	char *str;			/* sprintf destination, or NULL */
+	int len;			/* Characters in run */
+	char run[PRINT_RUN_LEN];
+};
+
+/* Default for platforms without a bulk output function */
+void __attribute__ ((weak)) printf_write(const char *s, int len)
 {
-	if (str) {
-		**str = c;
-		++(*str);
-	} else {
-		putchar(c);
+	while (len--)
+		putchar(*s++);
+}
+
+static void sink_flush(struct sink *sink)
+{
+	if (sink->len) {
+		printf_write(sink->run, sink->len);
+		sink->len = 0;
+	}
+}
+
+static inline void simple_outputchar(struct sink *sink, char c)
+{
+	if (sink->str) {
+		*sink->str++ = c;
+		return;
 	}
+
+	sink->run[sink->len++] = c;
+	if (sink->len == PRINT_RUN_LEN)
+		sink_flush(sink);
+}
+
+static void simple_outputs(struct sink *sink, const char *s, int len)
+{
+	while (len--)
+		simple_outputchar(sink, *s++);
+}
+
+static void simple_outputpad(struct sink *sink, char c, int count)
+{
+	while (count-- > 0)
+		simple_outputchar(sink, c);
 }
 
 enum flags {
@@ -58,100 +104,176 @@ enum flags {
 	PAD_RIGHT	= 2,
 };
 
-static int prints(char **out, const char *string, int width, int flags)
+static int prints(struct sink *sink, const char *string, int len, int width, int flags)
 {
-	int pc = 0, padchar = ' ';
-
-	if (width > 0) {
-		int len = 0;
-		const char *ptr;
-		for (ptr = string; *ptr; ++ptr) ++len;
-		if (len >= width) width = 0;
-		else width -= len;
-		if (flags & PAD_ZERO)
-			padchar = '0';
-	}
-	if (!(flags & PAD_RIGHT)) {
-		for ( ; width > 0; --width) {
-			simple_outputchar(out, padchar);
-			++pc;
-		}
-	}
-	for ( ; *string ; ++string) {
-		simple_outputchar(out, *string);
-		++pc;
-	}
-	for ( ; width > 0; --width) {
-		simple_outputchar(out, padchar);
-		++pc;
-	}
+	int pad = width > len ? width - len : 0;
 
-	return pc;
+	if (!(flags & PAD_RIGHT))
+		simple_outputpad(sink, flags & PAD_ZERO ? '0' : ' ', pad);
+	simple_outputs(sink, string, len);
+	if (flags & PAD_RIGHT)
+		simple_outputpad(sink, flags & PAD_ZERO ? '0' : ' ', pad);
+
+	return len + pad;
 }
 
-#define PRINT_BUF_LEN 64
+static const char digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static const char hex_digits[2][16] = {
+	"0123456789abcdef",
+	"0123456789ABCDEF",
+};
 
-static int simple_outputi(char **out, int i, int base, int sign, int width, int flags, int letbase)
+/*
+ * Format u in decimal, two digits at a time. Division by the constant 100 is
+ * a multiplication, so there are no divide instructions.
+ * \return start of the digits, which end before end
+ */
+static char *format_dec(char *end, unsigned long u)
 {
-	char print_buf[PRINT_BUF_LEN];
-	char *s;
-	int t, neg = 0, pc = 0;
-	unsigned int u = i;
-
-	if (i == 0) {
-		print_buf[0] = '0';
-		print_buf[1] = '\0';
-		return prints(out, print_buf, width, flags);
+	const char *pair;
+	unsigned long q;
+
+	while (u >= 100) {
+		q = u / 100;
+		pair = &digit_pairs[(u - q * 100) * 2];
+		*--end = pair[1];
+		*--end = pair[0];
+		u = q;
 	}
 
-	if (sign && base == 10 && i < 0) {
-		neg = 1;
-		u = -i;
+	if (u >= 10) {
+		pair = &digit_pairs[u * 2];
+		*--end = pair[1];
+		*--end = pair[0];
+	} else {
+		*--end = '0' + u;
 	}
+	return end;
+}
 
-	s = print_buf + PRINT_BUF_LEN-1;
-	*s = '\0';
+/* Format u in hex, with shifts rather than division */
+static char *format_hex(char *end, unsigned long u, const char *digits)
+{
+	do {
+		*--end = digits[u & 0xf];
+		u >>= 4;
+	} while (u);
+	return end;
+}
 
-	while (u) {
-		t = u % base;
-		if( t >= 10 )
-			t += letbase - '0' - 10;
-		*--s = t + '0';
-		u /= base;
+#if __SIZEOF_LONG__ < __SIZEOF_LONG_LONG__
+/*
+ * Format a 64 bit u where long is 32 bits. There is no libgcc to do 64 bit
+ * division, so 4 decimal digits at a time are divided off 16 bits of u at a
+ * time, which only needs 32 bit arithmetic.
+ */
+static char *format_dec_ll(char *end, unsigned long long u)
+{
+	unsigned long hi = u >> 32, lo = u, r, q3, q2, q1, q0;
+	const char *pair;
+
+	while (hi) {
+		r = hi >> 16;
+		q3 = r / 10000;
+		r = (r - q3 * 10000) << 16 | (hi & 0xffff);
+		q2 = r / 10000;
+		r = (r - q2 * 10000) << 16 | (lo >> 16);
+		q1 = r / 10000;
+		r = (r - q1 * 10000) << 16 | (lo & 0xffff);
+		q0 = r / 10000;
+		r -= q0 * 10000;
+
+		hi = q3 << 16 | q2;
+		lo = q1 << 16 | q0;
+
+		pair = &digit_pairs[(r % 100) * 2];
+		*--end = pair[1];
+		*--end = pair[0];
+		pair = &digit_pairs[(r / 100) * 2];
+		*--end = pair[1];
+		*--end = pair[0];
 	}
+	return format_dec(end, lo);
+}
 
-	if (neg) {
-		if( width && (flags & PAD_ZERO) ) {
-			simple_outputchar (out, '-');
-			++pc;
-			--width;
-		}
-		else {
-			*--s = '-';
+static char *format_hex_ll(char *end, unsigned long long u, const char *digits)
+{
+	unsigned long hi = u >> 32, lo = u;
+	int i;
+
+	if (!hi)
+		return format_hex(end, lo, digits);
+
+	for (i = 0; i < 8; i++, lo >>= 4)
+		*--end = digits[lo & 0xf];
+	return format_hex(end, hi, digits);
+}
+#else
+/* long is already 64 bits */
+#define format_dec_ll(end, u)		format_dec(end, u)
+#define format_hex_ll(end, u, digits)	format_hex(end, u, digits)
+#endif /* __SIZEOF_LONG__ < __SIZEOF_LONG_LONG__ */
+
+/* Enough for a 64 bit number in decimal, with a sign */
+#define PRINT_BUF_LEN 24
+
+/*
+ * Output a number, preceded by prefix (a sign or 0x), padded to width
+ */
+static int simple_outputi(struct sink *sink, unsigned long long u, const char *prefix,
+			  int base, int width, int flags, int upper)
+{
+	char print_buf[PRINT_BUF_LEN];
+	char *end = print_buf + PRINT_BUF_LEN, *s;
+	int pc = 0, len;
+
+	if (base == 16)
+		s = format_hex_ll(end, u, hex_digits[upper]);
+	else
+		s = format_dec_ll(end, u);
+
+	if (prefix) {
+		for (len = 0; prefix[len]; len++)
+			;
+
+		if (width && (flags & PAD_ZERO)) {
+			/* Zeroes go between the prefix and the digits */
+			simple_outputs(sink, prefix, len);
+			pc += len;
+			width -= len;
+		} else {
+			while (len--)
+				*--s = prefix[len];
 		}
 	}
 
-	return pc + prints (out, s, width, flags);
+	return pc + prints(sink, s, end - s, width, flags);
 }
 
 
-static int simple_vsprintf(char **out, char *format, va_list ap)
+static int simple_vsprintf(struct sink *sink, char *format, va_list ap)
 {
-	int width, flags;
+	int width, flags, length, len;
 	int pc = 0;
-	char scr[2];
-	union {
-		char c;
-		char *s;
-		int i;
-		unsigned int u;
-		void *p;
-	} u;
+	unsigned long long u;
+	long long i;
+	char *s, c;
 
 	for (; *format != 0; ++format) {
 		if (*format == '%') {
 			++format;
-			width = flags = 0;
+			width = flags = length = 0;
 			if (*format == '\0')
 				break;
 			if (*format == '%')
@@ -173,37 +295,53 @@ static int simple_vsprintf(char **out, char *format, va_list ap)
 					width += *format - '0';
 				}
 			}
+			/* l for long, ll for long long */
+			for ( ; *format == 'l'; ++format)
+				length++;
+
 			switch (*format) {
 				case('d'):
-					u.i = va_arg(ap, int);
-					pc += simple_outputi(out, u.i, 10, 1, width, flags, 'a');
+				case('i'):
+					if (length > 1)
+						i = va_arg(ap, long long);
+					else if (length)
+						i = va_arg(ap, long);
+					else
+						i = va_arg(ap, int);
+					pc += simple_outputi(sink, i < 0 ? -(unsigned long long)i : i,
+							     i < 0 ? "-" : NULL, 10, width, flags, 0);
 					break;
 
 				case('u'):
-					u.u = va_arg(ap, unsigned int);
-					pc += simple_outputi(out, u.u, 10, 0, width, flags, 'a');
-					break;
-
 				case('x'):
-					u.u = va_arg(ap, unsigned int);
-					pc += simple_outputi(out, u.u, 16, 0, width, flags, 'a');
+				case('X'):
+					if (length > 1)
+						u = va_arg(ap, unsigned long long);
+					else if (length)
+						u = va_arg(ap, unsigned long);
+					else
+						u = va_arg(ap, unsigned int);
+					pc += simple_outputi(sink, u, NULL, *format == 'u' ? 10 : 16,
+							     width, flags, *format == 'X');
 					break;
 
-				case('X'):
-					u.u = va_arg(ap, unsigned int);
-					pc += simple_outputi(out, u.u, 16, 0, width, flags, 'A');
+				case('p'):
+					u = (unsigned long)va_arg(ap, void *);
+					pc += simple_outputi(sink, u, "0x", 16, width, flags, 0);
 					break;
 
 				case('c'):
-					u.c = va_arg(ap, int);
-					scr[0] = u.c;
-					scr[1] = '\0';
-					pc += prints(out, scr, width, flags);
+					c = va_arg(ap, int);
+					pc += prints(sink, &c, 1, width, flags);
 					break;
 
 				case('s'):
-					u.s = va_arg(ap, char *);
-					pc += prints(out, u.s ? u.s : "(null)", width, flags);
+					s = va_arg(ap, char *);
+					if (!s)
+						s = "(null)";
+					for (len = 0; s[len]; len++)
+						;
+					pc += prints(sink, s, len, width, flags);
 					break;
 				default:
 					break;
@@ -211,21 +349,25 @@ static int simple_vsprintf(char **out, char *format, va_list ap)
 		}
 		else {
 out:
-			simple_outputchar (out, *format);
+			simple_outputchar(sink, *format);
 			++pc;
 		}
 	}
-	if (out) **out = '\0';
+	if (sink->str)
+		*sink->str = '\0';
+	else
+		sink_flush(sink);
 	return pc;
 }
 
 int simple_printf(char *fmt, ...)
 {
+	struct sink sink = { .str = NULL, .len = 0 };
 	va_list ap;
 	int r;
 
 	va_start(ap, fmt);
-	r = simple_vsprintf(NULL, fmt, ap);
+	r = simple_vsprintf(&sink, fmt, ap);
 	va_end(ap);
 
 	return r;
@@ -233,11 +375,12 @@ int simple_printf(char *fmt, ...)
 
 int simple_sprintf(char *buf, char *fmt, ...)
 {
+	struct sink sink = { .str = buf, .len = 0 };
 	va_list ap;
 	int r;
 
 	va_start(ap, fmt);
-	r = simple_vsprintf(&buf, fmt, ap);
+	r = simple_vsprintf(&sink, fmt, ap);
 	va_end(ap);
 
 	return r;
@@ -246,6 +389,56 @@ int simple_sprintf(char *buf, char *fmt, ...)
 
 #ifdef TEST
 
+/* Formats checked against the C library and timed */
+#define CHECK(fmt, ...)							\
+	do {								\
+		char a[256], b[256];					\
+		struct timespec t0, t1, t2;				\
+		int n;							\
+									\
+		simple_sprintf(a, fmt, ##__VA_ARGS__);			\
+		snprintf(b, sizeof(b), fmt, ##__VA_ARGS__);		\
+		if (strcmp(a, b))					\
+			printf("MISMATCH %-12s \"%s\" != \"%s\"\n", fmt, a, b); \
+									\
+		clock_gettime(CLOCK_MONOTONIC, &t0);			\
+		for (n = 0; n < BENCH_ITERATIONS; n++)			\
+			simple_sprintf(a, fmt, ##__VA_ARGS__);		\
+		clock_gettime(CLOCK_MONOTONIC, &t1);			\
+		for (n = 0; n < BENCH_ITERATIONS; n++)			\
+			snprintf(b, sizeof(b), fmt, ##__VA_ARGS__);	\
+		clock_gettime(CLOCK_MONOTONIC, &t2);			\
+		printf("%-14s %8.1f %8.1f\n", fmt,			\
+		       elapsed_ns(&t0, &t1) / BENCH_ITERATIONS,		\
+		       elapsed_ns(&t1, &t2) / BENCH_ITERATIONS);	\
+	} while (0)
+
+#define BENCH_ITERATIONS 1000000
+
+static double elapsed_ns(struct timespec *a, struct timespec *b)
+{
+	return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+static void benchmark(void)
+{
+	static char shortstr[] = "Test";
+
+	printf("\n%-14s %8s %8s\n", "ns/call", "simple", "libc");
+	CHECK("%d", 12345);
+	CHECK("%d", -2345);
+	CHECK("%u", 4294964951u);
+	CHECK("%x", 0xfffedcbb);
+	CHECK("%08X", 0xbeef);
+	CHECK("%lu", 123456789UL);
+	CHECK("%llu", 18446744073709551615ULL);
+	CHECK("%lld", -9223372036854775807LL);
+	CHECK("%llx", 0x123456789abcdefULL);
+	CHECK("%p", (void *)0x80001234);
+	CHECK("%-6d|%6s", -42, shortstr);
+	CHECK("0x%02x: %d bytes", 0x41, 1024);
+}
+
 #define printf simple_printf
 #define sprintf simple_sprintf
 
@@ -275,11 +468,11 @@ int main(int argc, char *argv[])
 	printf("long hex:               \"%x\"\n", 0x12345L);
 	printf("long hex negative:      \"%x\"\n", -0x12345L);
 	printf("\n");
-	printf("zero-padded LD:         \"%010ld\"\n", 123456);
-	printf("zero-padded LDN:        \"%010ld\"\n", -123456);
-	printf("left-adjusted ZLDN:     \"%-010ld\"\n", -123456);
-	printf("space-padded LDN:       \"%10ld\"\n", -123456);
-	printf("left-adjusted SLDN:     \"%-10ld\"\n", -123456);
+	printf("zero-padded LD:         \"%010ld\"\n", 123456L);
+	printf("zero-padded LDN:        \"%010ld\"\n", -123456L);
+	printf("left-adjusted ZLDN:     \"%-010ld\"\n", -123456L);
+	printf("space-padded LDN:       \"%10ld\"\n", -123456L);
+	printf("left-adjusted SLDN:     \"%-10ld\"\n", -123456L);
 	printf("\n");
 	printf("variable pad width:     \"%0*d\"\n", 15, -2345);
 	printf("\n");
@@ -290,8 +483,15 @@ int main(int argc, char *argv[])
 	printf("space-padded string:    \"%10s\"\n", shortstr);
 	printf("left-adjusted S string: \"%-10s\"\n", shortstr);
 	printf("null string:            \"%s\"\n", (char *)NULL);
+	printf("\n");
+	printf("pointer:                \"%p\"\n", (void *)0x80001234);
+	printf("long long unsigned:     \"%llu\"\n", 18446744073709551615ULL);
+	printf("long long decimal:      \"%lld\"\n", -1234567890123LL);
+	printf("long long hex:          \"%llX\"\n", 0xfedcba9876543210ULL);
 
 	sprintf(buf, "decimal:\t\"%d\"\n", -2345);
 	printf("sprintf: %s", buf);
+
+	benchmark();
 }
 #endif /* TEST */
@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <asm/cache.h>
+#include <mem.h>
+#include <rpmsg.h>
+#include <stddef.h>
+#include <trace.h>
+
+void rpmsg_init(struct rpmsg_device *rdev, volatile struct fw_rsc_vdev *rsc,
+		struct rpmsg_endpoint *endpoints, int num_endpoints,
+		void (*notify)(void))
+{
+	memset(rdev, 0, sizeof(*rdev));
+	rdev->rsc = rsc;
+	rdev->endpoints = endpoints;
+	rdev->num_endpoints = num_endpoints;
+	rdev->notify = notify;
+}
+
+void rpmsg_set_phys_offset(struct rpmsg_device *rdev, long offset)
+{
+	rdev->phys_offset = offset;
+	vring_set_phys_offset(&rdev->incoming, offset);
+	vring_set_phys_offset(&rdev->outgoing, offset);
+}
+
+/*
+ * Set up the vrings once Linux has negotiated features and made them ready.
+ * With several vdevs, Linux may start the firmware while probing the first,
+ * before it has got to this one.
+ */
+static int rpmsg_start(struct rpmsg_device *rdev)
+{
+	volatile struct fw_rsc_vdev *rsc = rdev->rsc;
+	uint32_t features;
+
+	if (rdev->started)
+		return 1;
+
+	/*
+	 * The resource table is mapped cached. The header is smaller than a
+	 * line, so it is written back rather than discarded, which is safe
+	 * whether or not Linux writes it coherently.
+	 */
+	dcache_inv_range((void *)rsc, sizeof(*rsc));
+	if (!(rsc->status & VIRTIO_CONFIG_S_DRIVER_OK))
+		return 0;
+
+	features = rsc->gfeatures;
+	vring_init(&rdev->outgoing, &rsc->vring[0]);
+	vring_init(&rdev->incoming, &rsc->vring[1]);
+	vring_set_features(&rdev->outgoing, features);
+	vring_set_features(&rdev->incoming, features);
+	rpmsg_set_phys_offset(rdev, rdev->phys_offset);
+
+	rdev->ns = !!(features & (1 << VIRTIO_RPMSG_F_NS));
+	rdev->started = 1;
+	TRACE("rpmsg started, features 0x%x", features);
+	return 1;
+}
+
+void *rpmsg_get_tx_buffer(struct rpmsg_device *rdev, int *len)
+{
+	void *buf;
+	int head;
+
+	head = vring_get_buffer_head(&rdev->outgoing, &buf, len);
+	if (head < 0)
+		return NULL;
+
+	rdev->tx_head = head;
+	rdev->tx_hdr = buf + rdev->phys_offset;
+	*len -= sizeof(struct rpmsg_hdr);
+	return rdev->tx_hdr->data;
+}
+
+int rpmsg_send_nocopy(struct rpmsg_device *rdev, uint32_t src, uint32_t dst,
+		      int len)
+{
+	struct rpmsg_hdr *hdr = rdev->tx_hdr;
+
+	hdr->src = src;
+	hdr->dst = dst;
+	hdr->reserved = 0;
+	hdr->len = len;
+	hdr->flags = 0;
+
+	rdev->tx_hdr = NULL;
+	vring_stage_buffer_head(&rdev->outgoing, rdev->tx_head,
+				sizeof(*hdr) + len);
+	return 0;
+}
+
+int rpmsg_send(struct rpmsg_device *rdev, uint32_t src, uint32_t dst,
+	       const void *data, int len)
+{
+	void *buf;
+	int size;
+
+	if (len > RPMSG_BUF_SIZE - (int)sizeof(struct rpmsg_hdr))
+		return -1;
+
+	buf = rpmsg_get_tx_buffer(rdev, &size);
+	if (!buf)
+		return -1;
+
+	/* Linux allocates buffers of RPMSG_BUF_SIZE, so this shouldn't happen */
+	if (len > size) {
+		TRACE("rpmsg buffer of %d bytes truncates message", size);
+		len = size;
+	}
+
+	memcpy(buf, data, len);
+	return rpmsg_send_nocopy(rdev, src, dst, len);
+}
+
+void rpmsg_flush(struct rpmsg_device *rdev)
+{
+	int in = rdev->incoming.used_staged;
+	int out = rdev->outgoing.used_staged;
+
+	if (!in && !out)
+		return;
+
+	vring_publish_used(&rdev->outgoing);
+	vring_publish_used(&rdev->incoming);
+
+	/* Send IPI to Linux to deal with consumed buffers, if it wants one */
+	if ((out && vring_need_notify(&rdev->outgoing)) |
+	    (in && vring_need_notify(&rdev->incoming)))
+		rdev->notify();
+}
+
+/* Announce endpoints to the name service, as Linux provides buffers for them */
+static void rpmsg_announce(struct rpmsg_device *rdev)
+{
+	struct rpmsg_endpoint *ept;
+	struct rpmsg_ns_msg msg;
+	int i;
+
+	for (; rdev->announced < rdev->num_endpoints; rdev->announced++) {
+		ept = &rdev->endpoints[rdev->announced];
+		if (!ept->name)
+			continue;
+
+		memset(&msg, 0, sizeof(msg));
+		for (i = 0; i < RPMSG_NAME_SIZE - 1 && ept->name[i]; i++)
+			msg.name[i] = ept->name[i];
+		msg.addr = ept->addr;
+		msg.flags = RPMSG_NS_CREATE;
+
+		if (rpmsg_send(rdev, ept->addr, RPMSG_NS_ADDR, &msg, sizeof(msg)))
+			break;
+		TRACE("Announced endpoint %d", ept->addr);
+	}
+}
+
+/*
+ * Is there a buffer to reply in? That is only a read of the outgoing vring.
+ * When there isn't, notifications are enabled on it so that Linux interrupts
+ * us when it returns one, as it may not otherwise with
+ * VIRTIO_RING_F_EVENT_IDX.
+ */
+static int rpmsg_tx_ready(struct rpmsg_device *rdev)
+{
+	if (vring_has_available(&rdev->outgoing))
+		return 1;
+
+	return vring_enable_notify(&rdev->outgoing);
+}
+
+/* Pass a message to the endpoint it is addressed to */
+static void rpmsg_dispatch(struct rpmsg_device *rdev, struct rpmsg_hdr *hdr)
+{
+	struct rpmsg_endpoint *ept;
+	int i;
+
+	for (i = 0; i < rdev->num_endpoints; i++) {
+		ept = &rdev->endpoints[i];
+		if (ept->addr == hdr->dst) {
+			ept->cb(rdev, ept, hdr->data, hdr->len, hdr->src);
+			return;
+		}
+	}
+
+	TRACE("Dropped rpmsg from %d to unknown %d", hdr->src, hdr->dst);
+	rdev->dropped++;
+}
+
+int rpmsg_handle_incoming(struct rpmsg_device *rdev)
+{
+	struct rpmsg_hdr *hdr;
+	int head, len, handled = 0;
+	void *buf;
+
+	if (!rpmsg_start(rdev))
+		return 0;
+
+	if (rdev->ns)
+		rpmsg_announce(rdev);
+
+	/*
+	 * Leave messages with Linux until it has returned a buffer for the
+	 * reply, rather than dropping replies while the announcement or a
+	 * burst of messages holds them all
+	 */
+	while (rpmsg_tx_ready(rdev) &&
+	       (head = vring_get_buffer_head(&rdev->incoming, &buf, &len)) >= 0) {
+		hdr = buf + rdev->phys_offset;
+		if (len >= (int)sizeof(*hdr) && hdr->len <= len - (int)sizeof(*hdr))
+			rpmsg_dispatch(rdev, hdr);
+		else
+			TRACE("Bad rpmsg buffer of %d bytes", len);
+
+		vring_stage_buffer_head(&rdev->incoming, head, len);
+		handled++;
+	}
+
+	/* Return the whole batch, and any replies, to Linux */
+	rpmsg_flush(rdev);
+
+	return handled;
+}
+
+int rpmsg_enable_notify(struct rpmsg_device *rdev)
+{
+	int pending, tx_ready;
+
+	if (!rdev->started)
+		return 0;
+
+	/* Both are enabled, so that either vring can wake us */
+	pending = vring_enable_notify(&rdev->incoming);
+	tx_ready = rpmsg_tx_ready(rdev);
+	return pending && tx_ready;
+}
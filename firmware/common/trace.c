@@ -36,23 +36,244 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <asm/barrier.h>
+#include <mem.h>
 #include <trace.h>
 
-static int trace_pos = 0;
+#ifndef __mips__
+/* Hosted build of the common code, see sim/ */
+#include <time.h>
+#endif /* __mips__ */
 
-char trace_buf[TRACE_BUFFER_SIZE];
+#ifdef TEST
+#include <stdio.h>
+#endif /* TEST */
 
-void trace_clear(void)
+/* Byte n of a header number */
+#define TRACE_HDR_BYTE(v, n)	(0x80 | (((v) >> (7 * (n))) & 0x7f))
+
+/* The header is valid from the start, with position and wrap count 0 */
+char trace_buf[TRACE_BUFFER_SIZE] = {
+	[TRACE_HDR_MAGIC] = 'T', 'R', 'C',
+	[TRACE_HDR_SIZE] = TRACE_HDR_BYTE(TRACE_DATA_SIZE, 0),
+			   TRACE_HDR_BYTE(TRACE_DATA_SIZE, 1),
+			   TRACE_HDR_BYTE(TRACE_DATA_SIZE, 2),
+	[TRACE_HDR_POSITION] = 0x80, 0x80, 0x80,
+	[TRACE_HDR_WRAP] = 0x80, 0x80, 0x80, 0x80,
+	[TRACE_HDR_SEQ] = 0x80,
+	[TRACE_HEADER_SIZE - 1] = '\n',
+};
+
+int trace_level = TRACE_LEVEL_ALL;
+
+static unsigned int trace_pos, trace_wrap, trace_wrap_published, trace_seq;
+
+static void trace_set_header(int offset, unsigned int value, int bytes)
 {
 	int i;
-	for (i = 0; i < sizeof(trace_buf); i++)
-		trace_buf[i] = 0;
-	trace_pos = 0;
+
+	for (i = 0; i < bytes; i++, value >>= 7)
+		trace_buf[offset + i] = 0x80 | (value & 0x7f);
 }
 
-void trace_putc(char c)
+static inline void trace_write(char c)
 {
-	trace_buf[trace_pos] = c;
-	if (++trace_pos >= sizeof(trace_buf))
+	trace_buf[TRACE_HEADER_SIZE + trace_pos] = c;
+	if (++trace_pos >= TRACE_DATA_SIZE) {
 		trace_pos = 0;
+		trace_wrap++;
+	}
+}
+
+/* Copy len bytes into the ring, in two parts if it wraps */
+static void trace_copy(const char *s, int len)
+{
+	unsigned int end = trace_pos + len, start = trace_pos, part;
+
+	if (end < TRACE_DATA_SIZE) {
+		memcpy(&trace_buf[TRACE_HEADER_SIZE + trace_pos], s, len);
+		trace_pos = end;
+		return;
+	}
+
+	/*
+	 * Only the most recent TRACE_DATA_SIZE bytes of a longer write survive,
+	 * so copy just those, placed to end at the new position
+	 */
+	if (len > TRACE_DATA_SIZE) {
+		s += len - TRACE_DATA_SIZE;
+		len = TRACE_DATA_SIZE;
+		start = end % TRACE_DATA_SIZE;
+	}
+
+	part = TRACE_DATA_SIZE - start;
+	memcpy(&trace_buf[TRACE_HEADER_SIZE + start], s, part);
+	memcpy(&trace_buf[TRACE_HEADER_SIZE], s + part, len - part);
+
+	trace_wrap += end / TRACE_DATA_SIZE;
+	trace_pos = end % TRACE_DATA_SIZE;
+}
+
+/* Tell the host about the data written since the last update */
+static void trace_update(void)
+{
+	/* The data must be visible before the position which covers it */
+	wmb();
+
+	/* Odd while the position and wrap count are inconsistent */
+	trace_set_header(TRACE_HDR_SEQ, ++trace_seq, 1);
+	wmb();
+
+	trace_set_header(TRACE_HDR_POSITION, trace_pos, 3);
+	if (trace_wrap != trace_wrap_published) {
+		trace_set_header(TRACE_HDR_WRAP, trace_wrap, 4);
+		trace_wrap_published = trace_wrap;
+	}
+
+	wmb();
+	trace_set_header(TRACE_HDR_SEQ, ++trace_seq, 1);
+}
+
+void trace_putc(char c)
+{
+	if (trace_level < TRACE_LEVEL_PRINTF)
+		return;
+
+	trace_write(c);
+	trace_update();
+}
+
+void trace_puts(const char *s, int len)
+{
+	if (trace_level < TRACE_LEVEL_PRINTF)
+		return;
+
+	trace_copy(s, len);
+	trace_update();
+}
+
+static inline unsigned long trace_timestamp(void)
+{
+#ifdef __mips__
+	unsigned int count;
+
+	__asm__ __volatile__("mfc0 %0, $9" : "=r" (count));
+	return count;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned int)(ts.tv_sec * 1000000000 + ts.tv_nsec);
+#endif /* __mips__ */
+}
+
+/* Encode a value without any 0 bytes, see TRACE */
+static inline char *trace_encode(char *p, unsigned long value)
+{
+	while (value >= 0x40) {
+		*p++ = 0x80 | (value & 0x7f);
+		value >>= 7;
+	}
+	*p++ = 0x40 | value;
+	return p;
+}
+
+void trace_record(unsigned long id, const long *args, int nargs)
+{
+	/* Start byte, then up to 10 bytes for each 64 bit value */
+	char record[1 + 10 * (2 + TRACE_MAX_ARGS)];
+	char *p = record;
+	int i;
+
+	if (nargs > TRACE_MAX_ARGS)
+		nargs = TRACE_MAX_ARGS;
+
+	*p++ = TRACE_RECORD_START;
+	p = trace_encode(p, id << 3 | nargs);
+	p = trace_encode(p, trace_timestamp());
+	for (i = 0; i < nargs; i++)
+		p = trace_encode(p, args[i]);
+
+	/* The host sees the whole record at once */
+	trace_copy(record, p - record);
+	trace_update();
+}
+
+#ifdef TEST
+
+/* Byte n of everything written to the trace buffer */
+static char test_byte(unsigned long n)
+{
+	/* 251 is prime, so a byte in the wrong place shows up */
+	return 1 + n % 251;
+}
+
+static unsigned int test_header(int offset, int bytes)
+{
+	unsigned int value = 0;
+
+	while (bytes--)
+		value = value << 7 | (trace_buf[offset + bytes] & 0x7f);
+	return value;
+}
+
+/*
+ * Check that the header accounts for total bytes, and that the ring holds the
+ * most recent of them, oldest at the position
+ */
+static int test_check(unsigned long total)
+{
+	unsigned int pos = test_header(TRACE_HDR_POSITION, 3);
+	unsigned int wrap = test_header(TRACE_HDR_WRAP, 4);
+	unsigned int seq = test_header(TRACE_HDR_SEQ, 1);
+	unsigned long n, kept = total < TRACE_DATA_SIZE ? total : TRACE_DATA_SIZE;
+
+	if ((unsigned long)wrap * TRACE_DATA_SIZE + pos != total) {
+		printf("FAIL after %lu bytes: position %u, wrap %u\n", total, pos, wrap);
+		return 1;
+	}
+
+	if (seq & 1) {
+		printf("FAIL after %lu bytes: sequence %u left odd\n", total, seq);
+		return 1;
+	}
+
+	for (n = total - kept; n < total; n++) {
+		if (trace_buf[TRACE_HEADER_SIZE + n % TRACE_DATA_SIZE] != test_byte(n)) {
+			printf("FAIL after %lu bytes: byte %lu is stale\n", total, n);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	/* Short writes, writes that wrap, and writes of more than the ring */
+	static const int lengths[] = {
+		1, 100, TRACE_DATA_SIZE - 101, 1, TRACE_DATA_SIZE, 3,
+		TRACE_DATA_SIZE + 1, 17, 3 * TRACE_DATA_SIZE + 5, 2000,
+		2 * TRACE_DATA_SIZE - 1, 1,
+	};
+	static char s[4 * TRACE_DATA_SIZE];
+	unsigned long total = 0;
+	int i, j, failed = 0;
+
+	for (i = 0; i < (int)(sizeof(lengths) / sizeof(lengths[0])); i++) {
+		for (j = 0; j < lengths[i]; j++)
+			s[j] = test_byte(total + j);
+
+		if (lengths[i] == 1)
+			trace_putc(s[0]);
+		else
+			trace_puts(s, lengths[i]);
+		total += lengths[i];
+
+		printf("%6d bytes, %6lu in all\n", lengths[i], total);
+		failed |= test_check(total);
+	}
+
+	printf("%s\n", failed ? "FAILED" : "PASSED");
+	return failed;
 }
+#endif /* TEST */
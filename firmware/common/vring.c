@@ -36,29 +36,95 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <asm/barrier.h>
+#include <mem.h>
+#include <stddef.h>
 #include <printf.h>
+#include <trace.h>
 #include <vring.h>
 
 void vring_init(struct vring *vring, volatile struct fw_rsc_vdev_vring *rsc)
 {
-	int used;
+	long used;
 
+	memset(vring, 0, sizeof(*vring));
 	vring->num_descriptors = rsc->num;
-	vring->desc = (void*)rsc->da;
-	vring->avail = (void*)rsc->da + rsc->num * sizeof(struct vring_desc);
+	vring->desc = (void*)(long)rsc->da;
+	vring->avail = (void*)(long)rsc->da + rsc->num * sizeof(struct vring_desc);
 
-	used = (int)vring->avail + sizeof(struct vring_avail) + rsc->num * sizeof(u16);
-	vring->used = (void*)((used + rsc->align) & ~(rsc->align-1));
+	/* The hosts used event index follows the avail ring */
+	vring->used_event = (void*)vring->avail + sizeof(struct vring_avail) + rsc->num * sizeof(u16);
+
+	used = (long)vring->used_event + sizeof(u16);
+	vring->used = (void*)((used + rsc->align - 1) & ~(rsc->align-1));
+
+	/* Our avail event index follows the used ring */
+	vring->avail_event = (void*)vring->used + sizeof(struct vring_used) + rsc->num * sizeof(struct vring_used_entry);
+}
+
+void vring_init_packed(struct vring *vring, volatile struct fw_rsc_vdev_vring *rsc)
+{
+	memset(vring, 0, sizeof(*vring));
+	vring->num_descriptors = rsc->num;
+	vring->packed = 1;
+	vring->packed_desc = (void*)(long)rsc->da;
+	vring->driver_event = (void*)vring->packed_desc + rsc->num * sizeof(struct vring_packed_desc);
+	vring->device_event = vring->driver_event + 1;
+
+	/* Both wrap counters start at 1 */
+	vring->avail_wrap = 1;
+	vring->used_wrap = 1;
+}
+
+void vring_set_features(struct vring *vring, uint32_t features)
+{
+	vring->event_idx = !!(features & (1 << VIRTIO_RING_F_EVENT_IDX));
+
+	/*
+	 * As the split rings zeroed avail event index, ask for a notification
+	 * at the start of the ring until vring_enable_notify is called
+	 */
+	if (vring->packed && vring->event_idx) {
+		vring->device_event->off_wrap = vring->avail_index |
+			vring->avail_wrap << VRING_PACKED_EVENT_F_WRAP_CTR;
+		vring->device_event->flags = VRING_PACKED_EVENT_FLAG_DESC;
+	}
+}
+
+void vring_set_phys_offset(struct vring *vring, long offset)
+{
+	vring->phys_offset = offset;
 }
 
 void vring_print(struct vring *vring)
 {
-	int i, j;
+	int i;
 
-	printf("vring at 0x%08x\n", (int)vring);
+	printf("vring at 0x%08x\n", (long)vring);
 	printf(" avail_index: %d\n", vring->avail_index);
 	printf(" used_index: %d\n", vring->used_index);
 
+	if (vring->packed) {
+		printf(" avail_wrap: %d\n", vring->avail_wrap);
+		printf(" used_wrap: %d\n", vring->used_wrap);
+
+		printf("\n descriptors:\n");
+		for (i = 0; i < vring->num_descriptors; i++) {
+			struct vring_packed_desc *desc = &vring->packed_desc[i];
+			printf("  desc %d (0x%08x)\n", i, desc);
+			printf("   address: 0x%08x\n", (int)desc->address);
+			printf("   length: 0x%x\n", desc->length);
+			printf("   id: 0x%04x\n", desc->id);
+			printf("   flags: 0x%04x\n", desc->flags);
+		}
+
+		printf("\n driver event: 0x%04x 0x%04x\n",
+		       vring->driver_event->off_wrap, vring->driver_event->flags);
+		printf(" device event: 0x%04x 0x%04x\n",
+		       vring->device_event->off_wrap, vring->device_event->flags);
+		return;
+	}
+
 	printf("\n descriptors:\n");
 	for (i = 0; i < vring->num_descriptors; i++) {
 		struct vring_desc *desc = &vring->desc[i];
@@ -84,51 +150,387 @@ void vring_print(struct vring *vring)
 	}
 }
 
+/* Is the descriptor at index in a packed ring available, given wrap counter? */
+static inline int vring_packed_is_avail(struct vring *vring, int index, int wrap)
+{
+	uint16_t flags = vring->packed_desc[index].flags;
+
+	return !!(flags & (1 << VRING_PACKED_DESC_F_AVAIL)) == wrap &&
+	       !!(flags & (1 << VRING_PACKED_DESC_F_USED)) != wrap;
+}
+
+/* Move a packed ring position on by count descriptors */
+static inline void vring_packed_advance(struct vring *vring, uint16_t *index,
+					uint16_t *wrap, int count)
+{
+	*index += count;
+	if (*index >= vring->num_descriptors) {
+		*index -= vring->num_descriptors;
+		*wrap ^= 1;
+	}
+}
+
+/* Wrap a position one lap past the end of a packed ring */
+static inline int vring_packed_wrap_index(struct vring *vring, int index)
+{
+	return index >= vring->num_descriptors ? index - vring->num_descriptors : index;
+}
+
+/* Number of descriptors in the packed chain starting at index */
+static int vring_packed_chain_length(struct vring *vring, int index)
+{
+	int count = 1;
+
+	while ((vring->packed_desc[index].flags & VRING_DESC_F_NEXT) &&
+	       count < vring->num_descriptors) {
+		if (++index == vring->num_descriptors)
+			index = 0;
+		count++;
+	}
+	return count;
+}
+
+static int vring_get_chain_packed(struct vring *vring, struct vring_iter *iter)
+{
+	int head = vring->avail_index, count, last;
+
+	if (!vring_packed_is_avail(vring, head, vring->avail_wrap))
+		return -1;
+
+	/* Read the rest of the chain only after seeing it is available */
+	rmb();
+
+	/* The buffer ID is in the last descriptor of the chain */
+	count = vring_packed_chain_length(vring, head);
+	last = vring_packed_wrap_index(vring, head + count - 1);
+	TRACE("avail desc %d, %d descs, id %d available",
+	      head, count, vring->packed_desc[last].id);
+
+	iter->table = vring->packed_desc;
+	iter->packed = 1;
+	iter->table_size = vring->num_descriptors;
+	iter->next = head;
+	iter->indirect = 0;
+	iter->phys_offset = vring->phys_offset;
+	iter->count = 0;
+	iter->length = 0;
+
+	vring_packed_advance(vring, &vring->avail_index, &vring->avail_wrap, count);
+	return vring->packed_desc[last].id;
+}
+
+int vring_get_chain(struct vring *vring, struct vring_iter *iter)
+{
+	int avail_index, desc_index;
+
+	if (vring->packed)
+		return vring_get_chain_packed(vring, iter);
+
+	if (vring->avail_index == vring->avail->index)
+		return -1;
+
+	/* Read the ring entry and descriptors only after seeing the index */
+	rmb();
+
+	avail_index = vring->avail_index & (vring->num_descriptors - 1);
+	desc_index = vring->avail->ring[avail_index];
+	TRACE("avail ring %d, desc %d available", avail_index, desc_index);
+
+	iter->table = vring->desc;
+	iter->packed = 0;
+	iter->table_size = vring->num_descriptors;
+	iter->next = desc_index < vring->num_descriptors ? desc_index : -1;
+	iter->indirect = 0;
+	iter->phys_offset = vring->phys_offset;
+	iter->count = 0;
+	iter->length = 0;
+
+	vring->avail_index++;
+	return desc_index;
+}
+
+int vring_iter_next(struct vring_iter *iter, void **buf, int *length, int *flags)
+{
+	uint64_t address;
+	uint32_t desc_length;
+	int desc_flags, next;
+
+	/* A chain can't be longer than the table, unless it loops */
+	if (iter->next < 0 || iter->count >= iter->table_size)
+		return 0;
+
+	if (iter->packed) {
+		struct vring_packed_desc *desc = (struct vring_packed_desc *)iter->table + iter->next;
+
+		address = desc->address;
+		desc_length = desc->length;
+		desc_flags = desc->flags & ~(1 << VRING_PACKED_DESC_F_AVAIL |
+					     1 << VRING_PACKED_DESC_F_USED);
+
+		/*
+		 * A chain continues in the following descriptor, wrapping
+		 * around the ring. An indirect table is a chain of every
+		 * descriptor in it, without VRING_DESC_F_NEXT.
+		 */
+		next = iter->next + 1;
+		if (iter->indirect) {
+			if (next < iter->table_size)
+				desc_flags |= VRING_DESC_F_NEXT;
+		} else if (next == iter->table_size) {
+			next = 0;
+		}
+	} else {
+		struct vring_desc *desc = (struct vring_desc *)iter->table + iter->next;
+
+		address = desc->address;
+		desc_length = desc->length;
+		desc_flags = desc->flags;
+		next = desc->next;
+	}
+
+	if ((desc_flags & VRING_DESC_F_INDIRECT) && !iter->indirect) {
+		/* Continue with the chain in the indirect table */
+		TRACE("  indirect: 0x%08x, length 0x%x", (long)address, desc_length);
+		iter->table = (void*)(long)address + iter->phys_offset;
+		iter->table_size = desc_length / sizeof(struct vring_desc);
+		iter->next = 0;
+		iter->indirect = 1;
+		iter->count = 0;
+		return vring_iter_next(iter, buf, length, flags);
+	}
+
+	TRACE("  address: 0x%08x, length: 0x%x, flags: 0x%04x, next: 0x%04x",
+	      (long)address, desc_length, desc_flags, next);
+
+	*buf = (void*)(long)address;
+	*length = desc_length;
+	if (flags)
+		*flags = desc_flags;
+
+	iter->count++;
+	iter->length += desc_length;
+
+	if ((desc_flags & VRING_DESC_F_NEXT) && next < iter->table_size)
+		iter->next = next;
+	else
+		iter->next = -1;
+	return 1;
+}
+
+int vring_iter_finish(struct vring_iter *iter)
+{
+	void *buf;
+	int length;
+
+	while (vring_iter_next(iter, &buf, &length, NULL))
+		;
+	return iter->length;
+}
+
+int vring_get_buffer_head(struct vring *vring, void **buf, int *length)
+{
+	struct vring_iter iter;
+	int head;
+
+	head = vring_get_chain(vring, &iter);
+	if (head >= 0 && !vring_iter_next(&iter, buf, length, NULL)) {
+		*buf = NULL;
+		*length = 0;
+	}
+	return head;
+}
+
 int vring_get_buffer(struct vring *vring, void **buf, int *length)
 {
-	if (vring->avail_index != vring->avail->index) {
-		int avail_index = vring->avail_index & (vring->num_descriptors - 1);
-		int desc_index = vring->avail->ring[avail_index];
-		struct vring_desc *desc = &vring->desc[desc_index];
+	return vring_get_buffer_head(vring, buf, length) >= 0;
+}
+
+/*
+ * Write a used descriptor over the chain at used_index, which is where the
+ * buffer was retrieved from as long as buffers are returned in order. The
+ * flags of the first used descriptor in a batch are held back, so that the
+ * host sees none of the batch until vring_publish_used.
+ */
+static int vring_stage_buffer_packed(struct vring *vring, int head, int length)
+{
+	struct vring_packed_desc *desc = &vring->packed_desc[vring->used_index];
+	int count, last;
+	uint16_t flags;
+
+	count = vring_packed_chain_length(vring, vring->used_index);
+	last = vring_packed_wrap_index(vring, vring->used_index + count - 1);
+	if (vring->packed_desc[last].id != head)
+		return 0;
 
-		printf("avail ring %d, desc %d available\n", avail_index, desc_index);
-		printf("  address: 0x%08x\n", (int)desc->address);
-		printf("  length: 0x%x\n", desc->length);
-		printf("  flags: 0x%04x\n", desc->flags);
-		printf("  next: 0x%04x\n", desc->next);
+	TRACE("desc %d is used, id %d", vring->used_index, head);
 
-		*buf = (void*)(long)desc->address;
-		*length = desc->length;
+	desc->id = head;
+	desc->length = length;
+	flags = vring->used_wrap ? 1 << VRING_PACKED_DESC_F_AVAIL |
+				   1 << VRING_PACKED_DESC_F_USED : 0;
 
-		vring->avail_index++;
-		return 1;
+	if (!vring->used_staged) {
+		vring->batch_index = vring->used_index;
+		vring->batch_flags = flags;
+	} else {
+		desc->flags = flags;
 	}
-	return 0;
+
+	vring_packed_advance(vring, &vring->used_index, &vring->used_wrap, count);
+	vring->used_added += count;
+	vring->used_staged++;
+	return 1;
+}
+
+int vring_stage_buffer_head(struct vring *vring, int head, int length)
+{
+	int index;
+
+	if (vring->packed)
+		return vring_stage_buffer_packed(vring, head, length);
+
+	if (head < 0 || head >= vring->num_descriptors)
+		return 0;
+
+	index = vring->used_index & (vring->num_descriptors - 1);
+
+	vring->used->ring[index].index = head;
+	vring->used->ring[index].length = length;
+
+	vring->used_index++;
+	vring->used_staged++;
+	TRACE("used ring %d = desc %d", index, head);
+	return 1;
+}
+
+void vring_publish_used(struct vring *vring)
+{
+	if (!vring->used_staged)
+		return;
+
+	/* Barrier before updating the index */
+	wmb();
+
+	if (vring->packed) {
+		/* Hand the first of the batch, and so all of it, to the host */
+		((volatile struct vring_packed_desc *)vring->packed_desc)[vring->batch_index].flags = vring->batch_flags;
+		vring->used_staged = 0;
+		TRACE("used desc %d, wrap %d", vring->used_index, vring->used_wrap);
+		return;
+	}
+
+	vring->used->index = vring->used_index;
+	vring->used_staged = 0;
+	TRACE("used ring index = %d", vring->used_index);
+}
+
+int vring_put_buffer_head(struct vring *vring, int head, int length)
+{
+	if (!vring_stage_buffer_head(vring, head, length))
+		return 0;
+
+	vring_publish_used(vring);
+	return 1;
+}
+
+int vring_has_available(struct vring *vring)
+{
+	if (vring->packed)
+		return vring_packed_is_avail(vring, vring->avail_index, vring->avail_wrap);
+
+	return vring->avail->index != vring->avail_index;
+}
+
+int vring_enable_notify(struct vring *vring)
+{
+	if (vring->packed) {
+		if (vring->event_idx) {
+			vring->device_event->off_wrap = vring->avail_index |
+				vring->avail_wrap << VRING_PACKED_EVENT_F_WRAP_CTR;
+			vring->device_event->flags = VRING_PACKED_EVENT_FLAG_DESC;
+		}
+
+		/* Order the event update before checking the next descriptor */
+		mb();
+
+		return vring_packed_is_avail(vring, vring->avail_index, vring->avail_wrap);
+	}
+
+	if (vring->event_idx)
+		*vring->avail_event = vring->avail_index;
+
+	/* Order the event index update before checking the avail index */
+	mb();
+
+	return vring->avail->index != vring->avail_index;
+}
+
+static int vring_need_notify_packed(struct vring *vring)
+{
+	uint16_t new = vring->used_index;
+	uint16_t old = new - vring->used_added;
+	uint16_t off_wrap, event;
+	int flags;
+
+	vring->used_added = 0;
+
+	/* Order the used descriptor updates before reading the hosts event */
+	mb();
+
+	flags = vring->driver_event->flags;
+	if (flags != VRING_PACKED_EVENT_FLAG_DESC)
+		return flags != VRING_PACKED_EVENT_FLAG_DISABLE;
+
+	/*
+	 * The event is a ring position - move it back a lap if it is before
+	 * our wrap, so the index arithmetic of the split ring works.
+	 */
+	off_wrap = vring->driver_event->off_wrap;
+	event = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+	if ((off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR) != vring->used_wrap)
+		event -= vring->num_descriptors;
+
+	return (uint16_t)(new - event - 1) < (uint16_t)(new - old);
+}
+
+int vring_need_notify(struct vring *vring)
+{
+	uint16_t old = vring->signalled_used;
+	uint16_t new = vring->used_index;
+
+	if (vring->packed)
+		return vring_need_notify_packed(vring);
+
+	vring->signalled_used = new;
+
+	/* Order the used index update before reading the hosts flags */
+	mb();
+
+	if (!vring->event_idx)
+		return !(vring->avail->flags & VRING_AVAIL_F_NO_INTERRUPT);
+
+	/* Has the used index moved past the hosts event index? */
+	return (uint16_t)(new - *vring->used_event - 1) < (uint16_t)(new - old);
 }
 
 int vring_put_buffer(struct vring *vring, void *buf, int length)
 {
 	int i;
 
+	if (vring->packed) {
+		/* Only the next buffer to be used can be returned */
+		i = vring_packed_wrap_index(vring, vring->used_index +
+				vring_packed_chain_length(vring, vring->used_index) - 1);
+
+		if ((void*)(long)vring->packed_desc[vring->used_index].address != buf)
+			return 0;
+		return vring_put_buffer_head(vring, vring->packed_desc[i].id, length);
+	}
+
 	for (i = 0; i < vring->num_descriptors; i++) {
 		struct vring_desc *desc = &vring->desc[i];
-		if ((void*)(long)desc->address == buf) {
-			int index = vring->used_index & (vring->num_descriptors - 1);
-			printf("desc %d is used\n", i);
-
-			vring->used->ring[index].index = i;
-			vring->used->ring[index].length = length;
-
-			/* Barrier before updating the index */
-			__asm__("ehb");
-			__asm__ __volatile__("sync" : : :"memory");
-
-			vring->used_index++;
-			vring->used->index = vring->used_index;
-			printf("used ring %d = desc %d\n", index, i);
-			printf("used ring index = %d\n", vring->used->index);
-			return 1;
-		}
+		if ((void*)(long)desc->address == buf)
+			return vring_put_buffer_head(vring, i, length);
 	}
 	return 0;
 }
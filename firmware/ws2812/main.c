@@ -48,100 +48,50 @@
 #define DMA_COHERENT 1
 
 #include <asm/remoteproc.h>
+#include <gic.h>
 #include <printf.h>
+#include <rsc_table.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <trace.h>
 #include <vring.h>
 
-#define GIC_LOCAL_INTERRUPTS 7
-
 extern const char _start[], _end[];
 
 /*
  * Resource table describe to remoteproc core the capabilities of
  * this firmware
  */
-struct __resource_table {
-	struct resource_table			header;
-
-	uint32_t				offset[3];
-
-	struct {
-		struct fw_rsc_hdr		header;
-		struct fw_rsc_carveout		carveout;
-	} carveout;
-
-	struct {
-		struct fw_rsc_hdr		header;
-		struct fw_rsc_trace		trace;
-	} trace;
-
-	struct {
-		struct fw_rsc_hdr		header;
-		struct fw_rsc_vdev		vdev;
-		struct fw_rsc_vdev_vring	vring[2];
-		uint8_t				config[0xc];
-	} vdev;
-} volatile resource_table __attribute__ ((section (".resource_table"))) = 
-{
-	.header = {
-		.ver = 1,	/* Verison 1 */
-		.num = 3,	/* 3 resources */
-	},
+#define RESOURCES(R)							\
+	R(carveout, RSC_CARVEOUT_ENTRY)					\
+	R(trace, RSC_TRACE_ENTRY)					\
+	R(vdev, RSC_VDEV_ENTRY(2, uint8_t config[0xc];))
 
-	/* Offsets of the 3 resource headers */
-	.offset[0] = offsetof(struct __resource_table, carveout),
-	.offset[1] = offsetof(struct __resource_table, trace),
-	.offset[2] = offsetof(struct __resource_table, vdev),
+RESOURCE_TABLE(RESOURCES) =
+{
+	RSC_TABLE_HEADER(RESOURCES),
 
 	/* Carveout resource to map firmware image into */
-	.carveout = {
-		.header = {
-			.type = RSC_CARVEOUT,
-		},
-		.carveout = {
-			.da = (uint32_t)&_start,
-			.pa = (uint32_t)&_start,
-			.len = 0x10000,//(long)(&_end) - (long)(&_start),
-			.name = "firmware",
-		},
-	},
+	.carveout = RSC_CARVEOUT_INIT((uint32_t)&_start,
+				      0x10000,//(long)(&_end) - (long)(&_start),
+				      "firmware"),
 
 	/* Trace resource to printf() into */
-	.trace = {
-		.header = {
-			.type = RSC_TRACE,
-		},
-		.trace = {
-			.da = (uint32_t)trace_buf,
-			.len = TRACE_BUFFER_SIZE,
-			.name = "trace",
-		},
-	},
+	.trace = RSC_TRACE_INIT((uint32_t)trace_buf, TRACE_BUFFER_SIZE, "trace"),
 
 	/* Virtual device resource for the virtual serial port */
 	.vdev = {
-		.header = {
-			.type = RSC_VDEV,
-		},
+		RSC_VDEV_HEADER,
 		.vdev = {
 			.id = 11, /* VIRTIO_ID_RPROC_SERIAL */
 			.notifyid = 4,
+			.dfeatures = 1 << VIRTIO_RING_F_EVENT_IDX,
 			.config_len = 0xc,
-			.num_of_vrings = 2,
+			RSC_VDEV_NUM_VRINGS(vdev),
 		},
-		
-		.vring[0] = {
-			.align = 0x1000,
-			.num = 0x4,
-			.notifyid = 1,
-		},
-		
-		.vring[1] = {
-			.align = 0x1000,
-			.num = 0x4,
-			.notifyid = 0,
+
+		.vring = {
+			RSC_VRING(1), RSC_VRING(0),
 		},
 	},
 };
@@ -149,10 +99,8 @@ struct __resource_table {
 struct vring vring_incoming;
 struct vring vring_outgoing;
 
-int interrupt_from_linux, interrupt_to_linux;
-
-void *cm_base;
-void *gic_base;
+/* The IPIs from and to Linux */
+struct gic_ipi ipi;
 
 static inline void *phys_to_virt(void *phys, int cached)
 {
@@ -165,87 +113,31 @@ static inline void *phys_to_virt(void *phys, int cached)
 
 void configure_interrupts(int irq_from_host, int irq_to_host)
 {
-	long flags;
-	int **gcr_gic_base;
-
-	/* Determine the base address of the CM */
-	__asm__("mfc0 %0, $15, 3" : "=r" (cm_base));
-	cm_base = (void*)((int)cm_base << 4);
-	cm_base = phys_to_virt(cm_base, 0);
-	printf("CM base address: 0x%08x\n", (int)cm_base);
-
-	/*
-	 * The CM register GCR_GIC_BASE register contains the base address of
-	 * the GIC - read the base address from it
-	 */
-	gcr_gic_base = cm_base + 0x80;
-	gic_base = *gcr_gic_base;
-	gic_base = phys_to_virt((void*)((int)gic_base & ~1), 0);
-	printf("GIC base address: 0x%08x\n", (int)gic_base);
-
-	/*
-	 * Ensure all local interrupts (i.e the timer) are disabled
-	 * Write to the GIC local reset mask register to clear all.
-	 */
-	*(int*)(gic_base + 0x8000 + 0xC) = 0x7F;
-
-	/*
-	 * The IPI numbers provided by Linux are offset by the number
-	 * of local interrupts in the GIC
-	 */
-	interrupt_from_linux = irq_from_host - GIC_LOCAL_INTERRUPTS;
-	interrupt_to_linux = irq_to_host - GIC_LOCAL_INTERRUPTS;
+	gic_init();
+	gic_ipi_init(&ipi, irq_from_host, irq_to_host);
 
 #if POLLED_MODE == 0
 	/* Enable the incoming IRQ */
-	{
-		volatile int *gic_set_mask_reg = (int*)((int)gic_base + 0x0380 + ((interrupt_from_linux / 32) * 4));
-		int gic_set_mask_bit = interrupt_from_linux % 32;
-
-		/* Write to the GIC set mask register to enable interrupt */
-		*gic_set_mask_reg = 1 << gic_set_mask_bit;
-		__asm__("sync");
-		__asm__("ehb");
-	}
-#endif
-
+	gic_irq_unmask(&ipi.from_host);
 
-	__asm__("mfc0 %0, $12, 0" : "=r" (flags));
-#if POLLED_MODE == 0
 	/* Enable interrupts! */
-	flags |= 1 << 10; /* IM2 */
-	flags |= 1; /* IE */
+	gic_cpu_irq_enable();
 #else
-	flags &= ~1; /* IE */
+	gic_cpu_irq_disable();
 #endif /* POLLED_MODE */
-	__asm__("mtc0 %0, $12, 0" : : "r" (flags));
-	__asm__("ehb");
 }
 
 /* Is the interrupt associated with linux -> remote asserted? */
 int gic_irq_from_host(void)
 {
-	volatile int *gic_pending_reg = (int*)((int)gic_base + 0x0480 + ((interrupt_from_linux / 32) * 4));
-	int gic_pending_bit = interrupt_from_linux % 32;
-
-	if ((*gic_pending_reg) & (1 << gic_pending_bit)) {
-		/* Ack the interrupt */
-		volatile int *gic_wedge_reg = (int*)((int)gic_base + 0x0280);
-
-		*gic_wedge_reg = interrupt_from_linux;
-
-		return 1;
-	}
-	return 0;
+	return gic_irq_ack(&ipi.from_host);
 }
 
 /* Assert the interrupt associated with remote -> linux */
 void gic_irq_to_host(void)
 {
-	volatile int *gic_wedge_reg = (int*)((int)gic_base + 0x0280);
-
-	printf("Asserting IRQ %d\n", interrupt_to_linux);
-	*gic_wedge_reg = (1 << 31) | interrupt_to_linux;
+	printf("Asserting IRQ %d\n", ipi.to_host.irq);
+	gic_irq_raise(&ipi.to_host);
 }
 
 
@@ -253,11 +145,12 @@ void handle_buffer(void *buffer, int len)
 {
 	uint8_t *out_buf;
 	uint8_t *in_buf = phys_to_virt(buffer, DMA_COHERENT);
-	int out_len;
+	int out_len, out_head;
 	int i;
 
 	/* Get a buffer in the outgoing vring */
-	if (!vring_get_buffer(&vring_outgoing, &buffer, &out_len))
+	out_head = vring_get_buffer_head(&vring_outgoing, &buffer, &out_len);
+	if (out_head < 0)
 		return;
 	printf("Got outgoing buffer length %d at 0x%08x\n", out_len, buffer);
 	out_buf = phys_to_virt(buffer, DMA_COHERENT);
@@ -278,33 +171,43 @@ void handle_buffer(void *buffer, int len)
 			out_buf[i] = in_buf[i];
 	}
 
-	/* Send the outgoing buffer to the host */
-	vring_put_buffer(&vring_outgoing, buffer, i);
+	/* Queue the outgoing buffer for the host */
+	vring_stage_buffer_head(&vring_outgoing, out_head, i);
 }
 
 
 void check_and_handle_incoming_buffers(void)
 {
-	int len;
+	int len, head;
 	void *buf;
 
 	if (gic_irq_from_host()) {
 		/* Linux has asserted the incoming IPI */
-		trace_clear();
 
-		/* Handle all newly available buffers */
-		while (vring_get_buffer(&vring_incoming, &buf, &len)) {
-			handle_buffer(buf, len);
+		/*
+		 * Handle all newly available buffers, until Linux has been
+		 * asked to notify us of any more
+		 */
+		do {
+			while ((head = vring_get_buffer_head(&vring_incoming, &buf, &len)) >= 0) {
+				handle_buffer(buf, len);
+
+				vring_stage_buffer_head(&vring_incoming, head, len);
+			}
+		} while (vring_enable_notify(&vring_incoming));
+
+		/* Return the whole batch to Linux */
+		vring_publish_used(&vring_outgoing);
+		vring_publish_used(&vring_incoming);
 
-			vring_put_buffer(&vring_incoming, buf, len);
-		}
 		printf("Incoming vring:\n");
 		vring_print(&vring_incoming);
 		printf("Outgoing vring:\n");
 		vring_print(&vring_outgoing);
 
-		/* Send IPI to Linux to deal with consumed buffers */
-		gic_irq_to_host();
+		/* Send IPI to Linux to deal with consumed buffers, if it wants one */
+		if (vring_need_notify(&vring_outgoing) | vring_need_notify(&vring_incoming))
+			gic_irq_to_host();
 	}
 }
 
@@ -497,6 +400,8 @@ void main(int fw_arg0, int fw_arg1, int fw_arg2, int fw_arg3)
 	 */
 	vring_init(&vring_outgoing, &resource_table.vdev.vring[0]);
 	vring_init(&vring_incoming, &resource_table.vdev.vring[1]);
+	vring_set_features(&vring_outgoing, resource_table.vdev.vdev.gfeatures);
+	vring_set_features(&vring_incoming, resource_table.vdev.vdev.gfeatures);
 
 	/* Set up the GIC */
 	configure_interrupts(fw_arg1, fw_arg2);
@@ -545,3 +450,8 @@ int putchar(char c)
 	/* Printf should be directed to the trace buffer */
 	trace_putc(c);
 }
+
+void printf_write(const char *s, int len)
+{
+	trace_puts(s, len);
+}
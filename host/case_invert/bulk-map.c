@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "bulk-map.h"
+
+int bulk_map_open(struct bulk_map *b, const char *path, off_t offset)
+{
+	volatile struct bulk_header *header;
+	int err;
+
+	memset(b, 0, sizeof(*b));
+
+	/* Uncached, as Linux and the firmware share it without coherent DMA */
+	b->fd = open(path, O_RDWR | O_SYNC);
+	if (b->fd < 0)
+		return -1;
+
+	/* Map the header first, to find out how big the carveout is */
+	header = mmap(NULL, BULK_SLOT_OFFSET, PROT_READ, MAP_SHARED, b->fd, offset);
+	if (header == MAP_FAILED)
+		goto err_close;
+
+	if (header->magic != BULK_MAGIC || !header->num_slots || !header->slot_size ||
+	    header->slot_offset < sizeof(*header)) {
+		munmap((void *)header, BULK_SLOT_OFFSET);
+		errno = ENODEV;
+		goto err_close;
+	}
+	b->slot_size = header->slot_size;
+	b->num_slots = header->num_slots;
+	b->slot_offset = header->slot_offset;
+	munmap((void *)header, BULK_SLOT_OFFSET);
+
+	b->size = b->slot_offset + (size_t)b->num_slots * b->slot_size;
+	b->base = mmap(NULL, b->size, PROT_READ | PROT_WRITE, MAP_SHARED, b->fd, offset);
+	if (b->base == MAP_FAILED)
+		goto err_close;
+
+	return 0;
+
+err_close:
+	err = errno;
+	close(b->fd);
+	errno = err;
+	return -1;
+}
+
+void bulk_map_close(struct bulk_map *b)
+{
+	munmap(b->base, b->size);
+	close(b->fd);
+}
+
+int bulk_map_alloc(struct bulk_map *b)
+{
+	int slot = b->head;
+
+	if (b->in_use == b->num_slots)
+		return -1;
+
+	b->head = (b->head + 1) % b->num_slots;
+	b->in_use++;
+	return slot;
+}
+
+int bulk_map_free(struct bulk_map *b, uint32_t slot)
+{
+	if (!b->in_use || slot != b->tail)
+		return -1;
+
+	b->tail = (b->tail + 1) % b->num_slots;
+	b->in_use--;
+	return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __BULK_MAP_H__
+#define __BULK_MAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* The layout of the carveout is shared with the firmware */
+#include "../../firmware/common/include/bulk.h"
+
+/*
+ * The bulk data carveout of a remote processor, mapped into user space. Slots
+ * are handed out as a ring: the firmware returns descriptors in the order they
+ * were sent, so they are freed oldest first.
+ */
+struct bulk_map {
+	int fd;
+	uint8_t *base;
+	size_t size;
+	uint32_t slot_size;
+	uint32_t num_slots;
+	uint32_t slot_offset;
+	uint32_t head;			/* Next slot to allocate */
+	uint32_t tail;			/* Oldest slot in use */
+	uint32_t in_use;
+};
+
+/*
+ * Map the carveout found at offset in path. That is its physical address in
+ * /dev/mem, or 0 for a UIO device mapping it or for memory shared with the
+ * simulation. Its size is read from the header the firmware writes.
+ * \return 0 on success, else -1 with errno set (ENODEV if there is no header)
+ */
+int bulk_map_open(struct bulk_map *b, const char *path, off_t offset);
+void bulk_map_close(struct bulk_map *b);
+
+/* \return the next free slot, or -1 if all are in use */
+int bulk_map_alloc(struct bulk_map *b);
+
+/*
+ * Free the oldest slot in use
+ * \return 0, or -1 if slot isn't the oldest
+ */
+int bulk_map_free(struct bulk_map *b, uint32_t slot);
+
+static inline uint8_t *bulk_map_slot(struct bulk_map *b, uint32_t slot)
+{
+	return b->base + b->slot_offset + (size_t)slot * b->slot_size;
+}
+
+#endif /* __BULK_MAP_H__ */
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/virtio_ids.h>
+#include <sys/mman.h>
+
+#include "fw-config-map.h"
+
+/*
+ * The parts of the resource table layout needed to find the block, as in
+ * firmware/common/include/asm/remoteproc.h. That can't be included here, as
+ * its asm/types.h would hide the system one.
+ */
+#define RSC_VDEV	3
+
+struct rsc_table_header {
+	uint32_t ver;
+	uint32_t num;
+	uint32_t reserved[2];
+	uint32_t offset[0];
+} __attribute__((__packed__));
+
+struct rsc_vdev {
+	uint32_t type;
+	uint32_t id;
+	uint32_t notifyid;
+	uint32_t dfeatures;
+	uint32_t gfeatures;
+	uint32_t config_len;
+	uint8_t status;
+	uint8_t num_of_vrings;
+	uint8_t reserved[2];
+} __attribute__((__packed__));
+
+/* Size of each vring in the vdev entry (struct fw_rsc_vdev_vring) */
+#define RSC_VRING_SIZE	20
+
+/* The table is a few hundred bytes; this much is mapped after its start */
+#define RSC_TABLE_MAP_SIZE	4096
+
+/* Open and map the table, with the cache attributes the firmware expects */
+static int fw_config_map_table(struct fw_config_map *m, const char *path,
+			       off_t offset, int cached)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	off_t base = offset & ~(off_t)(page - 1);
+
+	/* Without O_SYNC, /dev/mem maps RAM cached */
+	m->fd = open(path, O_RDWR | (cached ? 0 : O_SYNC));
+	if (m->fd < 0)
+		return -1;
+
+	m->size = offset - base + RSC_TABLE_MAP_SIZE;
+	m->base = mmap(NULL, m->size, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, base);
+	if (m->base == MAP_FAILED) {
+		int err = errno;
+
+		close(m->fd);
+		errno = err;
+		return -1;
+	}
+	return offset - base;
+}
+
+/* Find the block in the serial vdev of the table at start in the mapping */
+static volatile struct fw_config *fw_config_find(struct fw_config_map *m, int start)
+{
+	volatile uint8_t *table = (uint8_t *)m->base + start;
+	volatile struct rsc_table_header *header = (void *)table;
+	volatile struct rsc_vdev *vdev;
+	size_t limit = m->size - start, config;
+	uint32_t i, offset;
+
+	if (header->ver != 1 || header->num > (limit - sizeof(*header)) / sizeof(uint32_t))
+		return NULL;
+
+	for (i = 0; i < header->num; i++) {
+		offset = header->offset[i];
+		if (offset > limit - sizeof(*vdev))
+			return NULL;
+
+		vdev = (void *)(table + offset);
+		if (vdev->type != RSC_VDEV || vdev->id != VIRTIO_ID_RPROC_SERIAL ||
+		    vdev->config_len < FW_CONFIG_OFFSET + sizeof(struct fw_config))
+			continue;
+
+		config = offset + sizeof(*vdev) + vdev->num_of_vrings * RSC_VRING_SIZE +
+			 FW_CONFIG_OFFSET;
+		if (config > limit - sizeof(struct fw_config))
+			return NULL;
+		return (void *)(table + config);
+	}
+	return NULL;
+}
+
+int fw_config_map_open(struct fw_config_map *m, const char *path, off_t offset)
+{
+	int start, cached = 0;
+
+	memset(m, 0, sizeof(*m));
+
+	/*
+	 * Unless DMA is coherent, the firmware discards its cached copy of the
+	 * block before reading it, so it must be written uncached. With coherent
+	 * DMA it reads it through the cache, and must be written the same way.
+	 */
+	while (1) {
+		start = fw_config_map_table(m, path, offset, cached);
+		if (start < 0)
+			return -1;
+
+		m->config = fw_config_find(m, start);
+		if (!m->config) {
+			fw_config_map_close(m);
+			errno = ENODEV;
+			return -1;
+		}
+
+		if (cached || !(m->config->flags & FW_CONFIG_DMA_COHERENT))
+			return 0;
+
+		fw_config_map_close(m);
+		cached = 1;
+	}
+}
+
+void fw_config_map_close(struct fw_config_map *m)
+{
+	munmap(m->base, m->size);
+	close(m->fd);
+}
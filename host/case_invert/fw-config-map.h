@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __FW_CONFIG_MAP_H__
+#define __FW_CONFIG_MAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/* The configuration block is shared with the firmware */
+#include "../../firmware/common/include/fw_config.h"
+
+/*
+ * The configuration block of a running firmware, mapped into user space from
+ * its resource table, so that its mode, flags, trace level and poll budget
+ * can be changed without a kernel driver. The firmware reads the block again
+ * each time it is kicked, so a change takes effect from the next message.
+ */
+struct fw_config_map {
+	int fd;
+	void *base;
+	size_t size;
+	volatile struct fw_config *config;
+};
+
+/*
+ * Map the configuration block of the firmware whose resource table is at
+ * offset in path. That is the table's physical address in /dev/mem: the
+ * physical address of the "firmware" carveout, plus the offset of the
+ * .resource_table section from the start of the firmware image. The block is
+ * the one in the virtio serial vdev.
+ * \return 0 on success, else -1 with errno set (ENODEV if there is no table,
+ * or no block in it)
+ */
+int fw_config_map_open(struct fw_config_map *m, const char *path, off_t offset);
+void fw_config_map_close(struct fw_config_map *m);
+
+#endif /* __FW_CONFIG_MAP_H__ */
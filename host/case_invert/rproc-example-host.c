@@ -36,19 +36,86 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+
+#include "bulk-map.h"
+#include "fw-config-map.h"
+#include "uring.h"
+
+/*
+ * Largest buffer Linux gives the firmware to echo into (a page). Longer
+ * writes are truncated by the firmware, so streams are sent in chunks no
+ * bigger than this by default.
+ */
+#define STREAM_CHUNK	4096
+
+/* Where the bulk data carveout and the resource table are mapped from */
+#define MEM_DEVICE	"/dev/mem"
+
+/*
+ * From linux/rpmsg.h, which only exists from 4.11, along with the rpmsg_char
+ * driver it is for
+ */
+struct rpmsg_endpoint_info {
+	char name[32];
+	uint32_t src;
+	uint32_t dst;
+};
+
+#define RPMSG_CREATE_EPT_IOCTL	_IOW(0xb5, 0x1, struct rpmsg_endpoint_info)
+#define RPMSG_DESTROY_EPT_IOCTL	_IO(0xb5, 0x2)
+#define RPMSG_ADDR_ANY		0xffffffff
+
+/* Largest rpmsg message, a 512 byte buffer less the header */
+#define RPMSG_MAX_LEN		496
+
+/* Address of the firmware endpoint that case inverts bulk carveout slots */
+#define SLOTS_RPMSG_ADDR	1025
 
 static int fd_port;
 
 static void print_usage_exit(char *name)
 {
-	printf("Usage: %s <-l> -p <port>\n", name);
+	printf("Usage: %s <-l <iterations>> <-d <depth> | -r <rate>> <-j> <-u> -p <port> [-p <port>...]\n", name);
+	printf("       %s <-s <bytes> | -f <file>> <-c <chunk>> <-d <depth>> <-j> -p <port>\n", name);
+	printf("       %s -b <address> <-m <device>> -s <bytes> <-c <chunk>> <-d <depth>> <-j> -p <port>\n", name);
+	printf("       %s -t <address> <-m <device>> <-M <mode>> <-B <budget>> <-T <level>> <-F <flags>> [...]\n", name);
 	printf("  -l Activate a test loop\n");
+	printf("  -d <depth> Keep <depth> requests of the test loop in flight, without printing them\n");
+	printf("  -r <rate> Send the test loop at <rate> messages/s per port, however many are in flight\n");
+	printf("  -j Report test loop throughput and latency as JSON\n");
+	printf("  -u Drive the test loop with io_uring rather than epoll\n");
+	printf("  -s <bytes> Stream <bytes> of generated text through the port and check the echo\n");
+	printf("  -f <file> Stream the contents of <file> (or its first -s <bytes>)\n");
+	printf("  -c <chunk> Write streams in chunks of <chunk> bytes (default %d)\n", STREAM_CHUNK);
+	printf("  -b <address> Stream through the slots of the bulk carveout at <address> in the map\n");
+	printf("               device, sending only their descriptors over rpmsg. <port> is then\n");
+	printf("               an rpmsg_ctrl device, like /dev/rpmsg_ctrl0\n");
+	printf("  -m <device> Map the bulk carveout or resource table from <device> (default %s),\n", MEM_DEVICE);
+	printf("              e.g. /dev/uio0 with -b 0\n");
+	printf("  -t <address> Print the firmware configuration block, in the resource table at\n");
+	printf("               <address> in the map device, after making any changes below to it\n");
+	printf("  -M <mode> Set the servicing mode: interrupt, polled or hybrid\n");
+	printf("  -B <budget> Set the hybrid mode poll budget, in CP0 Count cycles\n");
+	printf("  -T <level> Set the trace level: 0 none, 1 printf text, 2 printf and TRACE records\n");
+	printf("  -F <flags> Set the flags: 1 DMA coherent, 2 access buffers cached with cache maintenance\n");
 	printf("  -p <port> Port is the virtio port created for the remote target like /dev/vport0p0\n");
+	printf("            Give several to run the test loop on each at once\n");
+	printf("            Optional with -t, which alone only changes the configuration\n");
 
 	exit(-1);
 }
@@ -56,7 +123,12 @@ static void print_usage_exit(char *name)
 static void echo_request(char *out_buf, int out_len)
 {
 	int in_len, in_total = 0;
-	char *in_buf = alloca(out_len);
+	char *in_buf = malloc(out_len + 1);
+
+	if (!in_buf) {
+		perror("Allocating response buffer");
+		exit(-1);
+	}
 
 	printf("Sending '%s'\n", out_buf);
 	if (write(fd_port, out_buf, out_len) != out_len) {
@@ -85,7 +157,7 @@ static void echo_request(char *out_buf, int out_len)
 			break;
 		}
 
-		in_len = read(fd_port, &in_buf[in_total], sizeof(in_buf));
+		in_len = read(fd_port, &in_buf[in_total], out_len - in_total);
 		if (in_len <= 0) {
 			perror("Error reading from port\n");
 			exit(-1);
@@ -93,6 +165,7 @@ static void echo_request(char *out_buf, int out_len)
 	}
 	in_buf[in_total] = '\0';
 	printf("Received '%s'\n", in_buf);
+	free(in_buf);
 }
 
 static void test_loop(int iterations)
@@ -108,6 +181,968 @@ static void test_loop(int iterations)
 	}
 }
 
+/* Maximum length of a test loop request */
+#define REQUEST_LEN	32
+
+/* Maximum number of ports driven at once */
+#define MAX_PORTS	16
+
+#define NSEC_PER_SEC	1000000000LL
+
+/*
+ * Log-linear latency histogram, in ns. Values below HIST_SUB are counted
+ * exactly, and each power of two above that is split into HIST_SUB linear
+ * buckets, so a bucket is within 1/HIST_SUB of the values counted in it.
+ */
+#define HIST_SUB_BITS	5
+#define HIST_SUB	(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS	((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct histogram {
+	unsigned long long count[HIST_BUCKETS];
+	unsigned long long total;
+	long long sum, max;
+};
+
+/*
+ * A port driven by the test loop. The port is a byte stream, so the echoes
+ * are matched against the requests in the order they were sent, whatever
+ * size of reads they arrive in.
+ */
+struct port {
+	const char *name;
+	int fd;
+	int events;			/* Events polled for */
+	int writing;			/* Write queued with io_uring */
+
+	int sent, done;			/* Requests sent and fully echoed */
+	char out_buf[REQUEST_LEN];	/* Request being sent */
+	int out_len, written;
+	char in_buf[4096];		/* Echoes being read */
+	char expect[REQUEST_LEN];	/* Request being echoed */
+	int expect_len, matched;
+
+	long long *sent_at;		/* Send times of requests in flight */
+	long long start, end;		/* Time of first send and last echo */
+	long long last;			/* Time of last progress */
+	struct histogram latency;
+};
+
+static struct port ports[MAX_PORTS];
+static int num_ports;
+
+/* Test loop settings */
+static int iterations;
+static int depth = 1;
+static int rate;
+
+static int hist_index(unsigned long long v)
+{
+	int shift;
+
+	if (v < HIST_SUB)
+		return v;
+	shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+	return shift * HIST_SUB + (v >> shift);
+}
+
+/* Highest value counted in bucket i */
+static long long hist_value(int i)
+{
+	int shift;
+
+	if (i < HIST_SUB)
+		return i;
+	shift = i / HIST_SUB - 1;
+	return ((long long)(i % HIST_SUB + HIST_SUB) << shift) + (1LL << shift) - 1;
+}
+
+static void hist_record(struct histogram *h, long long ns)
+{
+	if (ns < 0)
+		ns = 0;
+	h->count[hist_index(ns)]++;
+	h->total++;
+	h->sum += ns;
+	if (ns > h->max)
+		h->max = ns;
+}
+
+static void hist_add(struct histogram *h, struct histogram *from)
+{
+	int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+		h->count[i] += from->count[i];
+	h->total += from->total;
+	h->sum += from->sum;
+	if (from->max > h->max)
+		h->max = from->max;
+}
+
+static long long hist_percentile(struct histogram *h, double p)
+{
+	unsigned long long target = h->total * p / 100, seen = 0;
+	int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->count[i];
+		if (seen > target)
+			return hist_value(i) < h->max ? hist_value(i) : h->max;
+	}
+	return h->max;
+}
+
+static void latency_report(const char *name, int done, long long ns, int target,
+			   struct histogram *h, int json)
+{
+	double secs = (double)ns / NSEC_PER_SEC;
+
+	if (json) {
+		printf("{\"port\": \"%s\", \"messages\": %d, \"seconds\": %.3f, "
+		       "\"target_rate\": %d, \"achieved_rate\": %.0f, \"latency_us\": "
+		       "{\"mean\": %.1f, \"p50\": %.1f, \"p99\": %.1f, \"p99.9\": %.1f, "
+		       "\"max\": %.1f}}\n",
+		       name, done, secs, target, done / secs,
+		       h->sum / 1e3 / h->total,
+		       hist_percentile(h, 50) / 1e3, hist_percentile(h, 99) / 1e3,
+		       hist_percentile(h, 99.9) / 1e3, h->max / 1e3);
+		return;
+	}
+
+	printf("%s: %d messages in %.3f s, %.0f messages/s", name, done, secs, done / secs);
+	if (target)
+		printf(" (target %d/s)", target);
+	printf("\n  Latency mean %.1f us, p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+	       h->sum / 1e3 / h->total,
+	       hist_percentile(h, 50) / 1e3, hist_percentile(h, 99) / 1e3,
+	       hist_percentile(h, 99.9) / 1e3, h->max / 1e3);
+}
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static char case_invert(char c)
+{
+	if (c >= 'a' && c <= 'z')
+		return c - 0x20;
+	else if (c >= 'A' && c <= 'Z')
+		return c + 0x20;
+	return c;
+}
+
+/* Time the next request on p is due, with -r */
+static long long port_due(struct port *p)
+{
+	return p->start + p->sent * NSEC_PER_SEC / rate;
+}
+
+/*
+ * Whether p may send another request now. With -r requests are sent when
+ * they are due, however many are in flight, otherwise up to depth may be in
+ * flight.
+ */
+static int port_can_send(struct port *p, long long now)
+{
+	if (p->sent >= iterations)
+		return 0;
+	if (rate)
+		return port_due(p) <= now;
+	return p->sent - p->done < depth;
+}
+
+/*
+ * Start the next request in out_buf, if one may be sent now.
+ * \return 1 if there is a request to write
+ */
+static int port_next(struct port *p, long long now)
+{
+	if (p->written)
+		return 1;
+	if (!port_can_send(p, now))
+		return 0;
+
+	p->out_len = snprintf(p->out_buf, REQUEST_LEN, "Test %d", p->sent);
+	if (!rate)
+		p->sent_at[p->sent % depth] = now;
+	if (p->sent == p->done)
+		p->last = now;
+	return 1;
+}
+
+/* Account for len bytes of the request being written */
+static void port_written(struct port *p, int len)
+{
+	p->written += len;
+	if (p->written < p->out_len)
+		return;
+	p->written = 0;
+	p->sent++;
+}
+
+/* Match len bytes read from the port against the requests sent */
+static void port_match(struct port *p, const char *in_buf, int len, long long now)
+{
+	int i;
+
+	p->last = now;
+	for (i = 0; i < len; i++) {
+		if (!p->matched) {
+			if (p->done == p->sent && !p->written) {
+				printf("%s: Unexpected response to request %d\n", p->name, p->done);
+				exit(-1);
+			}
+			p->expect_len = snprintf(p->expect, REQUEST_LEN, "Test %d", p->done);
+		}
+
+		if (in_buf[i] != case_invert(p->expect[p->matched])) {
+			printf("%s: Unexpected response to request %d\n", p->name, p->done);
+			exit(-1);
+		}
+		if (++p->matched < p->expect_len)
+			continue;
+
+		/*
+		 * With -r, latency is measured from the time the request was due
+		 * to be sent rather than when it actually was, so that stalls in
+		 * sending (coordinated omission) count against every request
+		 * they delayed.
+		 */
+		if (rate)
+			hist_record(&p->latency, now - (p->start + p->done * NSEC_PER_SEC / rate));
+		else
+			hist_record(&p->latency, now - p->sent_at[p->done % depth]);
+		p->matched = 0;
+		p->done++;
+		p->end = now;
+	}
+}
+
+/* Check that a port waiting for an echo hasn't been waiting too long */
+static void port_check_timeout(struct port *p, long long now)
+{
+	if (p->sent != p->done && now - p->last > NSEC_PER_SEC) {
+		printf("%s: Timeout waiting for response %d\n", p->name, p->done);
+		exit(-1);
+	}
+}
+
+/* \return 1 if the port can't take more until it is writable again */
+static int port_send(struct port *p, long long now)
+{
+	int out_len;
+
+	while (port_next(p, now)) {
+		out_len = write(p->fd, &p->out_buf[p->written], p->out_len - p->written);
+		if (out_len < 0 && errno == EAGAIN)
+			return 1;
+		if (out_len < 0) {
+			perror("Error writing to port\n");
+			exit(-1);
+		}
+		port_written(p, out_len);
+	}
+	return 0;
+}
+
+static void port_receive(struct port *p, long long now)
+{
+	int in_len;
+
+	in_len = read(p->fd, p->in_buf, sizeof(p->in_buf));
+	if (in_len < 0 && errno == EAGAIN)
+		return;
+	if (in_len <= 0) {
+		perror("Error reading from port\n");
+		exit(-1);
+	}
+	port_match(p, p->in_buf, in_len, now);
+}
+
+static void port_poll(int epfd, struct port *p, int events)
+{
+	struct epoll_event ev = {
+		.events = events,
+		.data.ptr = p,
+	};
+
+	if (events == p->events)
+		return;
+	if (epoll_ctl(epfd, p->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, p->fd, &ev)) {
+		perror("epoll_ctl");
+		exit(-1);
+	}
+	p->events = events;
+}
+
+static long long ports_start(int json)
+{
+	long long now = now_ns();
+	struct port *p;
+	int i;
+
+	if (!json) {
+		if (rate)
+			printf("Sending %d messages at %d/s on %d port(s)\n", iterations, rate, num_ports);
+		else
+			printf("Looping %d times, %d in flight on %d port(s)\n", iterations, depth, num_ports);
+	}
+
+	for (i = 0; i < num_ports; i++) {
+		p = &ports[i];
+
+		p->sent_at = calloc(depth, sizeof(*p->sent_at));
+		if (!p->sent_at) {
+			perror("Allocating requests");
+			exit(-1);
+		}
+		p->start = p->last = now;
+	}
+	return now;
+}
+
+static void ports_report(long long start, int json)
+{
+	struct histogram *total = calloc(1, sizeof(*total));
+	long long end = 0;
+	int i, done = 0;
+	struct port *p;
+
+	if (!total) {
+		perror("Allocating histogram");
+		exit(-1);
+	}
+
+	for (i = 0; i < num_ports; i++) {
+		p = &ports[i];
+
+		latency_report(p->name, p->done, p->end - p->start, rate, &p->latency, json);
+		hist_add(total, &p->latency);
+		done += p->done;
+		if (p->end > end)
+			end = p->end;
+		free(p->sent_at);
+	}
+	if (num_ports > 1)
+		latency_report("total", done, end - start, rate * num_ports, total, json);
+
+	free(total);
+}
+
+/*
+ * Drive the test loop on every port from one epoll loop. With -r, a timerfd
+ * wakes the loop when the next request on any port is due.
+ */
+static void test_ports(int json)
+{
+	struct epoll_event events[MAX_PORTS + 1];
+	long long now, next, armed = 0, start;
+	int epfd, tfd = -1, remaining;
+	struct port *p;
+	int i, n;
+
+	epfd = epoll_create1(0);
+	if (epfd < 0) {
+		perror("epoll_create1");
+		exit(-1);
+	}
+
+	if (rate) {
+		struct epoll_event ev = {
+			.events = EPOLLIN,
+			.data.ptr = NULL,
+		};
+
+		tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+		if (tfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev)) {
+			perror("timerfd");
+			exit(-1);
+		}
+	}
+
+	/* Writes mustn't block while echoes are waiting to be read */
+	for (i = 0; i < num_ports; i++)
+		fcntl(ports[i].fd, F_SETFL, fcntl(ports[i].fd, F_GETFL) | O_NONBLOCK);
+
+	start = now = ports_start(json);
+
+	for (remaining = num_ports; remaining; ) {
+		next = 0;
+		for (i = 0; i < num_ports; i++) {
+			p = &ports[i];
+
+			if (p->done == iterations)
+				continue;
+
+			port_check_timeout(p, now);
+			port_poll(epfd, p, EPOLLIN | (port_send(p, now) ? EPOLLOUT : 0));
+
+			if (rate && p->sent < iterations && (!next || port_due(p) < next))
+				next = port_due(p);
+		}
+
+		if (next != armed) {
+			struct itimerspec its = {
+				.it_value = {
+					.tv_sec = next / NSEC_PER_SEC,
+					.tv_nsec = next % NSEC_PER_SEC,
+				},
+			};
+
+			timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+			armed = next;
+		}
+
+		n = epoll_wait(epfd, events, num_ports + 1, 100);
+		if (n < 0 && errno != EINTR) {
+			perror("epoll_wait");
+			exit(-1);
+		}
+
+		now = now_ns();
+		for (i = 0; i < n; i++) {
+			uint64_t expirations;
+
+			p = events[i].data.ptr;
+			if (!p) {
+				if (read(tfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+					perror("timerfd");
+				armed = 0;
+				continue;
+			}
+
+			if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+				port_receive(p, now);
+
+			if (p->done == iterations) {
+				epoll_ctl(epfd, EPOLL_CTL_DEL, p->fd, NULL);
+				p->events = 0;
+				remaining--;
+			}
+		}
+	}
+
+	ports_report(start, json);
+	if (tfd >= 0)
+		close(tfd);
+	close(epfd);
+}
+
+/* io_uring user_data for the timeout, others are port index * 2 + is write */
+#define URING_TIMEOUT	(~0ULL)
+
+/* Longest the io_uring loop waits before checking for timeouts */
+#define URING_TICK	(NSEC_PER_SEC / 10)
+
+static void uring_prep_rw(struct uring *ring, int op, int i, void *buf, int len)
+{
+	struct io_uring_sqe *sqe = uring_get_sqe(ring);
+
+	/* The ring has room for a read and a write per port and the timeout */
+	sqe->opcode = op;
+	sqe->flags = IOSQE_FIXED_FILE;
+	sqe->fd = i;
+	sqe->off = -1;			/* The port isn't seekable */
+	sqe->addr = (unsigned long)buf;
+	sqe->len = len;
+	sqe->buf_index = i * 2 + (op == IORING_OP_WRITE_FIXED);
+	sqe->user_data = i * 2 + (op == IORING_OP_WRITE_FIXED);
+}
+
+/*
+ * Drive the test loop on every port with io_uring. Each port always has a
+ * read queued, and a write whenever it has a request to send, to and from
+ * buffers registered with the kernel in advance. All new entries are
+ * submitted, and completions waited for, in a single system call per pass.
+ */
+static void test_ports_uring(int json)
+{
+	static struct __kernel_timespec ts;
+	struct iovec iov[2 * MAX_PORTS];
+	int fds[MAX_PORTS];
+	struct io_uring_cqe *cqe;
+	struct uring ring;
+	long long now, next, start;
+	int i, remaining, timer = 0;
+	struct port *p;
+
+	if (uring_init(&ring, 2 * MAX_PORTS + 1)) {
+		perror("io_uring_setup");
+		exit(-1);
+	}
+
+	for (i = 0; i < num_ports; i++) {
+		fds[i] = ports[i].fd;
+		iov[i * 2].iov_base = ports[i].in_buf;
+		iov[i * 2].iov_len = sizeof(ports[i].in_buf);
+		iov[i * 2 + 1].iov_base = ports[i].out_buf;
+		iov[i * 2 + 1].iov_len = sizeof(ports[i].out_buf);
+	}
+	if (uring_register_files(&ring, fds, num_ports) ||
+	    uring_register_buffers(&ring, iov, num_ports * 2)) {
+		perror("io_uring_register");
+		exit(-1);
+	}
+
+	start = now = ports_start(json);
+	for (i = 0; i < num_ports; i++)
+		uring_prep_rw(&ring, IORING_OP_READ_FIXED, i, ports[i].in_buf,
+			      sizeof(ports[i].in_buf));
+
+	for (remaining = num_ports; remaining; ) {
+		next = now + URING_TICK;
+		for (i = 0; i < num_ports; i++) {
+			p = &ports[i];
+
+			if (p->done == iterations)
+				continue;
+
+			port_check_timeout(p, now);
+			if (!p->writing && port_next(p, now)) {
+				uring_prep_rw(&ring, IORING_OP_WRITE_FIXED, i,
+					      &p->out_buf[p->written], p->out_len - p->written);
+				p->writing = 1;
+			}
+
+			if (rate && p->sent < iterations && port_due(p) < next)
+				next = port_due(p);
+		}
+
+		if (!timer) {
+			struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+
+			ts.tv_sec = next / NSEC_PER_SEC;
+			ts.tv_nsec = next % NSEC_PER_SEC;
+			sqe->opcode = IORING_OP_TIMEOUT;
+			sqe->addr = (unsigned long)&ts;
+			sqe->len = 1;
+			sqe->timeout_flags = IORING_TIMEOUT_ABS;
+			sqe->user_data = URING_TIMEOUT;
+			timer = 1;
+		}
+
+		if (uring_submit_and_wait(&ring, 1) < 0 && errno != EINTR) {
+			perror("io_uring_enter");
+			exit(-1);
+		}
+
+		now = now_ns();
+		while ((cqe = uring_peek_cqe(&ring))) {
+			unsigned long long data = cqe->user_data;
+			int res = cqe->res;
+
+			uring_cqe_seen(&ring);
+			if (data == URING_TIMEOUT) {
+				timer = 0;
+				continue;
+			}
+
+			i = data / 2;
+			p = &ports[i];
+			if (data & 1) {
+				p->writing = 0;
+				/* An interrupted write is queued again next pass */
+				if (res == -EINTR || res == -EAGAIN)
+					continue;
+				if (res < 0) {
+					errno = -res;
+					perror("Error writing to port\n");
+					exit(-1);
+				}
+				port_written(p, res);
+				continue;
+			}
+
+			if (res == -EINTR || res == -EAGAIN) {
+				uring_prep_rw(&ring, IORING_OP_READ_FIXED, i, p->in_buf,
+					      sizeof(p->in_buf));
+				continue;
+			}
+			if (res <= 0) {
+				errno = -res;
+				perror("Error reading from port\n");
+				exit(-1);
+			}
+			port_match(p, p->in_buf, res, now);
+
+			if (p->done == iterations)
+				remaining--;
+			else
+				uring_prep_rw(&ring, IORING_OP_READ_FIXED, i, p->in_buf,
+					      sizeof(p->in_buf));
+		}
+	}
+
+	ports_report(start, json);
+	uring_exit(&ring);
+}
+
+/* Pattern the stream is generated from when no file is given */
+static const char stream_pattern[] = "The Quick Brown Fox Jumps Over The Lazy Dog. ";
+
+/* A chunk of the stream, kept until its echo has been checked */
+struct chunk {
+	char *buf;
+	int len;
+};
+
+/* Fill buf with len bytes of the stream from offset, from fd or the pattern */
+static int stream_fill(int fd, char *buf, int len, long long offset)
+{
+	int i, n;
+
+	if (fd < 0) {
+		for (i = 0; i < len; i++)
+			buf[i] = stream_pattern[(offset + i) % (sizeof(stream_pattern) - 1)];
+		return len;
+	}
+
+	for (i = 0; i < len; i += n) {
+		n = read(fd, &buf[i], len - i);
+		if (n < 0) {
+			perror("Reading stream file");
+			exit(-1);
+		}
+		if (!n)
+			break;
+	}
+	return i;
+}
+
+/*
+ * Stream size bytes (or the whole of file) through the first port, in
+ * chunks of chunk_size. Up to depth chunks are in flight, each held in a
+ * buffer from a pool until its echo has been checked against it.
+ */
+static void test_stream(const char *file, long long size, int chunk_size, int json)
+{
+	struct chunk *pool = calloc(depth, sizeof(*pool));
+	int head = 0, in_flight = 0, written = 0, matched = 0;
+	long long sent = 0, done = 0, start, now, last;
+	int in_size = chunk_size * depth;
+	char *in_buf = malloc(in_size);
+	int fd = -1, in_len, i;
+	struct chunk *c;
+	double secs;
+
+	if (!pool || !in_buf) {
+		perror("Allocating stream buffers");
+		exit(-1);
+	}
+	for (i = 0; i < depth; i++) {
+		pool[i].buf = malloc(chunk_size);
+		if (!pool[i].buf) {
+			perror("Allocating stream buffers");
+			exit(-1);
+		}
+	}
+
+	if (file) {
+		struct stat st;
+
+		fd = open(file, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st)) {
+			perror("Opening stream file");
+			exit(-1);
+		}
+		if (!size || size > st.st_size)
+			size = st.st_size;
+	}
+
+	fcntl(fd_port, F_SETFL, fcntl(fd_port, F_GETFL) | O_NONBLOCK);
+
+	if (!json)
+		printf("Streaming %lld bytes in %d byte chunks, %d in flight\n",
+		       size, chunk_size, depth);
+	start = now = last = now_ns();
+
+	while (done < size) {
+		int want_write = written || (sent < size && in_flight < depth);
+		fd_set rset, wset;
+		struct timeval timeout = {
+			.tv_sec = 1,
+		};
+
+		FD_ZERO(&rset);
+		FD_ZERO(&wset);
+		FD_SET(fd_port, &rset);
+		if (want_write)
+			FD_SET(fd_port, &wset);
+
+		if (select(fd_port + 1, &rset, &wset, NULL, &timeout) < 0) {
+			perror("Select");
+			exit(-1);
+		}
+		now = now_ns();
+		if (now - last > NSEC_PER_SEC) {
+			printf("Timeout waiting for response at byte %lld\n", done);
+			exit(-1);
+		}
+
+		if (FD_ISSET(fd_port, &wset)) {
+			c = &pool[(head + in_flight) % depth];
+			if (!written) {
+				c->len = chunk_size < size - sent ? chunk_size : size - sent;
+				c->len = stream_fill(fd, c->buf, c->len, sent);
+				if (!c->len) {
+					printf("Stream file ended early\n");
+					exit(-1);
+				}
+			}
+
+			in_len = write(fd_port, &c->buf[written], c->len - written);
+			if (in_len < 0 && errno != EAGAIN) {
+				perror("Error writing to port\n");
+				exit(-1);
+			}
+			if (in_len > 0)
+				written += in_len;
+			if (written == c->len) {
+				if (!in_flight)
+					last = now;
+				sent += c->len;
+				written = 0;
+				in_flight++;
+			}
+		}
+
+		if (!FD_ISSET(fd_port, &rset))
+			continue;
+
+		in_len = read(fd_port, in_buf, in_size);
+		if (in_len < 0 && errno == EAGAIN)
+			continue;
+		if (in_len <= 0) {
+			perror("Error reading from port\n");
+			exit(-1);
+		}
+
+		last = now;
+		for (i = 0; i < in_len; i++) {
+			c = &pool[head];
+
+			if (!in_flight || in_buf[i] != case_invert(c->buf[matched])) {
+				printf("Unexpected response at byte %lld\n", done + matched);
+				exit(-1);
+			}
+			if (++matched < c->len)
+				continue;
+
+			/* The chunk is checked, so its buffer can be reused */
+			done += c->len;
+			matched = 0;
+			head = (head + 1) % depth;
+			in_flight--;
+		}
+	}
+
+	secs = (double)(now - start) / NSEC_PER_SEC;
+	if (json)
+		printf("{\"bytes\": %lld, \"chunk\": %d, \"depth\": %d, \"seconds\": %.3f, "
+		       "\"mb_per_s\": %.2f}\n", done, chunk_size, depth, secs, done / secs / 1e6);
+	else
+		printf("%lld bytes in %.3f s, %.2f MB/s\n", done, secs, done / secs / 1e6);
+
+	for (i = 0; i < depth; i++)
+		free(pool[i].buf);
+	free(pool);
+	free(in_buf);
+	if (fd >= 0)
+		close(fd);
+}
+
+/*
+ * Create an rpmsg_char endpoint device to address dst in the firmware, with
+ * the rpmsg_ctrl device open at ctrl_fd, and open it. The device is found by
+ * the name it was given, which is made unique to this process.
+ * \return file descriptor of the endpoint device, or -1
+ */
+static int rpmsg_open_endpoint(int ctrl_fd, uint32_t dst)
+{
+	struct rpmsg_endpoint_info info = {
+		.src = RPMSG_ADDR_ANY,
+		.dst = dst,
+	};
+	char path[300], name[sizeof(info.name) + 1];
+	long long start = now_ns();
+	struct dirent *d;
+	DIR *dir;
+	FILE *f;
+	int fd;
+
+	snprintf(info.name, sizeof(info.name), "case-invert-%d", getpid());
+	if (ioctl(ctrl_fd, RPMSG_CREATE_EPT_IOCTL, &info))
+		return -1;
+
+	/* udev creates the device node once the endpoint has been added */
+	do {
+		dir = opendir("/sys/class/rpmsg");
+		if (!dir)
+			return -1;
+
+		while ((d = readdir(dir))) {
+			/* Endpoint devices are rpmsgN, beside rpmsg_ctrlN */
+			if (strncmp(d->d_name, "rpmsg", 5) || !isdigit(d->d_name[5]))
+				continue;
+
+			snprintf(path, sizeof(path), "/sys/class/rpmsg/%s/name", d->d_name);
+			f = fopen(path, "r");
+			if (!f)
+				continue;
+			if (!fgets(name, sizeof(name), f))
+				name[0] = '\0';
+			fclose(f);
+			name[strcspn(name, "\n")] = '\0';
+			if (strcmp(name, info.name))
+				continue;
+
+			snprintf(path, sizeof(path), "/dev/%s", d->d_name);
+			fd = open(path, O_RDWR);
+			if (fd >= 0) {
+				closedir(dir);
+				return fd;
+			}
+		}
+		closedir(dir);
+		usleep(10000);
+	} while (now_ns() - start < NSEC_PER_SEC);
+
+	errno = ENODEV;
+	return -1;
+}
+
+/*
+ * Stream size bytes of generated text through the slots of the bulk carveout,
+ * in chunks of up to chunk_size. Each chunk is written straight into a slot,
+ * and only its descriptor is sent, in an rpmsg message to the firmware's
+ * slots endpoint through an endpoint device created on the rpmsg_ctrl port.
+ * Up to depth slots are in flight and the firmware case inverts each in
+ * place, so the echo is checked in the slot once its descriptor comes back.
+ */
+static void test_bulk(const char *device, off_t address, long long size,
+		      int chunk_size, int json)
+{
+	struct bulk_desc descs[RPMSG_MAX_LEN / sizeof(struct bulk_desc)];
+	long long *offsets, sent = 0, done = 0, start, now, last;
+	struct bulk_map b;
+	int len, n, i, slot;
+	uint8_t *buf;
+	double secs;
+
+	if (bulk_map_open(&b, device, address)) {
+		perror("Mapping bulk carveout");
+		exit(-1);
+	}
+
+	/* Each write is one message, and each read one reply */
+	fd_port = rpmsg_open_endpoint(fd_port, SLOTS_RPMSG_ADDR);
+	if (fd_port < 0) {
+		perror("Creating rpmsg endpoint");
+		exit(-1);
+	}
+	if (chunk_size > b.slot_size)
+		chunk_size = b.slot_size;
+	if (depth > b.num_slots)
+		depth = b.num_slots;
+	if (depth > sizeof(descs) / sizeof(descs[0]))
+		depth = sizeof(descs) / sizeof(descs[0]);
+
+	/* Offset in the stream of the chunk in each slot */
+	offsets = calloc(b.num_slots, sizeof(*offsets));
+	if (!offsets) {
+		perror("Allocating bulk offsets");
+		exit(-1);
+	}
+
+	if (!json)
+		printf("Streaming %lld bytes in %d byte chunks through %u slots of %u bytes, %d in flight\n",
+		       size, chunk_size, b.num_slots, b.slot_size, depth);
+	start = now = last = now_ns();
+
+	while (done < size) {
+		fd_set rset;
+		struct timeval timeout = {
+			.tv_sec = 1,
+		};
+
+		/* Fill free slots, then send all their descriptors in one write */
+		for (n = 0; sent < size && b.in_use < depth; n++) {
+			slot = bulk_map_alloc(&b);
+			len = chunk_size < size - sent ? chunk_size : size - sent;
+			stream_fill(-1, (char *)bulk_map_slot(&b, slot), len, sent);
+
+			descs[n].slot = slot;
+			descs[n].len = len;
+			offsets[slot] = sent;
+			sent += len;
+		}
+		if (n && write(fd_port, descs, n * sizeof(descs[0])) != n * sizeof(descs[0])) {
+			perror("Error writing to port\n");
+			exit(-1);
+		}
+
+		FD_ZERO(&rset);
+		FD_SET(fd_port, &rset);
+		if (select(fd_port + 1, &rset, NULL, NULL, &timeout) < 0) {
+			perror("Select");
+			exit(-1);
+		}
+		now = now_ns();
+		if (now - last > NSEC_PER_SEC) {
+			printf("Timeout waiting for response at byte %lld\n", done);
+			exit(-1);
+		}
+		if (!FD_ISSET(fd_port, &rset))
+			continue;
+
+		/* Descriptors come back whole, in the order they were sent */
+		len = read(fd_port, descs, sizeof(descs));
+		if (len <= 0 || len % sizeof(descs[0])) {
+			perror("Error reading from port\n");
+			exit(-1);
+		}
+
+		last = now;
+		for (n = 0; n < len / sizeof(descs[0]); n++) {
+			slot = descs[n].slot;
+			if (bulk_map_free(&b, slot) || offsets[slot] != done) {
+				printf("Unexpected slot %d at byte %lld\n", slot, done);
+				exit(-1);
+			}
+
+			buf = bulk_map_slot(&b, slot);
+			for (i = 0; i < descs[n].len; i++) {
+				if (buf[i] != case_invert(stream_pattern[(done + i) % (sizeof(stream_pattern) - 1)])) {
+					printf("Unexpected response at byte %lld\n", done + i);
+					exit(-1);
+				}
+			}
+			if (!descs[n].len) {
+				printf("Slot %d not handled\n", slot);
+				exit(-1);
+			}
+			done += descs[n].len;
+		}
+	}
+
+	secs = (double)(now - start) / NSEC_PER_SEC;
+	if (json)
+		printf("{\"bytes\": %lld, \"chunk\": %d, \"depth\": %d, \"bulk\": true, \"seconds\": %.3f, "
+		       "\"mb_per_s\": %.2f}\n", done, chunk_size, depth, secs, done / secs / 1e6);
+	else
+		printf("%lld bytes in %.3f s, %.2f MB/s\n", done, secs, done / secs / 1e6);
+
+	free(offsets);
+	bulk_map_close(&b);
+	ioctl(fd_port, RPMSG_DESTROY_EPT_IOCTL);
+	close(fd_port);
+}
+
 static void test_interactive(void)
 {
 	int len;
@@ -128,35 +1163,185 @@ static void test_interactive(void)
 	}
 }
 
+static const char *const fw_modes[] = {
+	[FW_MODE_INTERRUPT] = "interrupt",
+	[FW_MODE_POLLED] = "polled",
+	[FW_MODE_HYBRID] = "hybrid",
+};
+
+/* \return the FW_MODE_* named, or given as a number, by s, or -1 */
+static int parse_mode(const char *s)
+{
+	char *end;
+	long mode;
+	int i;
+
+	for (i = 0; i < sizeof(fw_modes) / sizeof(fw_modes[0]); i++)
+		if (!strcmp(s, fw_modes[i]))
+			return i;
+
+	mode = strtol(s, &end, 0);
+	return *s && !*end && mode >= 0 && mode <= FW_MODE_HYBRID ? mode : -1;
+}
+
+/*
+ * Change the firmware configuration block, in the resource table at address
+ * in device, with the values that aren't negative, then print it. The
+ * firmware reads it again when it is next kicked.
+ */
+static void configure_firmware(const char *device, off_t address, int mode,
+			       long long budget, int level, int flags)
+{
+	volatile struct fw_config *config;
+	struct fw_config_map m;
+
+	if (fw_config_map_open(&m, device, address)) {
+		perror("Mapping firmware configuration block");
+		exit(-1);
+	}
+	config = m.config;
+
+	if (flags >= 0)
+		config->flags = flags;
+	if (level >= 0)
+		config->trace_level = level;
+	if (budget >= 0)
+		config->poll_budget = budget;
+	/* The mode last, so that a switch to hybrid mode sees its budget */
+	if (mode >= 0)
+		config->mode = mode;
+
+	printf("Firmware mode %s, flags 0x%x, trace level %d, poll budget %u\n",
+	       config->mode <= FW_MODE_HYBRID ? fw_modes[config->mode] : "unknown",
+	       config->flags, config->trace_level, config->poll_budget);
+
+	fw_config_map_close(&m);
+}
+
 int main(int argc, char*argv[])
 {
-	int c;
-	int loop = 0;
-	const char *port = NULL;
+	int c, i;
+	int json = 0;
+	int uring = 0;
+	long long stream = 0;
+	const char *file = NULL;
+	int chunk = STREAM_CHUNK;
+	const char *mem_device = MEM_DEVICE;
+	long long bulk_address = -1;
+	long long table_address = -1;
+	int mode = -1, level = -1, flags = -1;
+	long long budget = -1;
 
 
 	opterr = 0;
-	while ((c = getopt (argc, argv, "l:p:")) != -1)
+	while ((c = getopt (argc, argv, "B:F:M:T:b:c:d:f:jl:m:p:r:s:t:u")) != -1)
 	switch (c)
 	{
+	case 'B':
+		budget = strtoll(optarg, NULL, 0);
+		if (budget < 0 || budget > UINT32_MAX)
+			print_usage_exit(argv[0]);
+		break;
+	case 'F':
+		flags = strtol(optarg, NULL, 0);
+		if (flags < 0 || flags > (FW_CONFIG_DMA_COHERENT | FW_CONFIG_DMA_CACHE_OPS))
+			print_usage_exit(argv[0]);
+		break;
+	case 'M':
+		mode = parse_mode(optarg);
+		if (mode < 0)
+			print_usage_exit(argv[0]);
+		break;
+	case 'T':
+		level = atoi(optarg);
+		if (level < 0 || level > 2)
+			print_usage_exit(argv[0]);
+		break;
+	case 'b':
+		bulk_address = strtoll(optarg, NULL, 0);
+		break;
+	case 'c':
+		chunk = atoi(optarg);
+		break;
+	case 'd':
+		depth = atoi(optarg);
+		break;
+	case 'f':
+		file = optarg;
+		break;
+	case 'j':
+		json = 1;
+		break;
 	case 'l':
-		loop = atoi(optarg);
+		iterations = atoi(optarg);
+		break;
+	case 'm':
+		mem_device = optarg;
 		break;
 	case 'p':
-		port = optarg;
+		if (num_ports == MAX_PORTS)
+			print_usage_exit(argv[0]);
+		ports[num_ports++].name = optarg;
+		break;
+	case 'r':
+		rate = atoi(optarg);
+		break;
+	case 's':
+		stream = atoll(optarg);
+		break;
+	case 't':
+		table_address = strtoll(optarg, NULL, 0);
+		break;
+	case 'u':
+		uring = 1;
 		break;
 	default:
 		print_usage_exit(argv[0]);
 	}
 
-	fd_port = open(port, O_RDWR);
-	if (fd_port < 0) {
-		perror("Couldn't open port");
+	/* Configuration changes need the table */
+	if (table_address < 0 && (mode >= 0 || budget >= 0 || level >= 0 || flags >= 0))
+		print_usage_exit(argv[0]);
+
+	if (table_address >= 0) {
+		configure_firmware(mem_device, table_address, mode, budget, level, flags);
+		if (!num_ports)
+			return 0;
+	}
+
+	if (!num_ports || depth < 1 || rate < 0 || (rate && depth > 1))
 		print_usage_exit(argv[0]);
+
+	/* Several ports can only be driven by the test loop */
+	if (num_ports > 1 && !iterations)
+		print_usage_exit(argv[0]);
+
+	if ((stream || file) && (iterations || rate || uring || chunk < 1))
+		print_usage_exit(argv[0]);
+
+	/* Bulk streams are generated, and checked in place */
+	if (bulk_address >= 0 && (!stream || file))
+		print_usage_exit(argv[0]);
+
+	for (i = 0; i < num_ports; i++) {
+		ports[i].fd = open(ports[i].name, O_RDWR);
+		if (ports[i].fd < 0) {
+			perror("Couldn't open port");
+			print_usage_exit(argv[0]);
+		}
 	}
+	fd_port = ports[0].fd;
 
-	if (loop)
-		test_loop(loop);
+	if (bulk_address >= 0)
+		test_bulk(mem_device, bulk_address, stream, chunk, json);
+	else if (stream || file)
+		test_stream(file, stream, chunk, json);
+	else if (iterations && uring)
+		test_ports_uring(json);
+	else if (iterations && (rate || depth > 1 || json || num_ports > 1))
+		test_ports(json);
+	else if (iterations)
+		test_loop(iterations);
 	else
 		test_interactive();
 }
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "uring.h"
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+int uring_init(struct uring *ring, unsigned entries)
+{
+	struct io_uring_params p;
+	size_t sq_size, cq_size;
+	void *sq, *cq;
+
+	memset(&p, 0, sizeof(p));
+	memset(ring, 0, sizeof(*ring));
+
+	ring->fd = io_uring_setup(entries, &p);
+	if (ring->fd < 0)
+		return -1;
+
+	sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+	/* Newer kernels map both rings with the one mmap */
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cq_size > sq_size)
+			sq_size = cq_size;
+		cq_size = sq_size;
+	}
+
+	sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		  ring->fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED)
+		goto err;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
+	} else {
+		cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			  ring->fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED)
+			goto err;
+	}
+
+	ring->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+			  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			  ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED)
+		goto err;
+
+	ring->sq_head = sq + p.sq_off.head;
+	ring->sq_tail = sq + p.sq_off.tail;
+	ring->sq_mask = sq + p.sq_off.ring_mask;
+	ring->sq_array = sq + p.sq_off.array;
+	ring->sq_entries = p.sq_entries;
+	ring->sq_local_tail = *ring->sq_tail;
+
+	ring->cq_head = cq + p.cq_off.head;
+	ring->cq_tail = cq + p.cq_off.tail;
+	ring->cq_mask = cq + p.cq_off.ring_mask;
+	ring->cqes = cq + p.cq_off.cqes;
+	return 0;
+
+err:
+	/* The mappings go when the process exits, as it will */
+	close(ring->fd);
+	return -1;
+}
+
+void uring_exit(struct uring *ring)
+{
+	close(ring->fd);
+}
+
+int uring_register_buffers(struct uring *ring, const struct iovec *iov, unsigned nr)
+{
+	return io_uring_register(ring->fd, IORING_REGISTER_BUFFERS, iov, nr);
+}
+
+int uring_register_files(struct uring *ring, const int *fds, unsigned nr)
+{
+	return io_uring_register(ring->fd, IORING_REGISTER_FILES, fds, nr);
+}
+
+struct io_uring_sqe *uring_get_sqe(struct uring *ring)
+{
+	unsigned tail = ring->sq_local_tail;
+	unsigned index = tail & *ring->sq_mask;
+	struct io_uring_sqe *sqe;
+
+	if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries)
+		return NULL;
+
+	sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	ring->sq_array[index] = index;
+	ring->sq_local_tail = tail + 1;
+	return sqe;
+}
+
+int uring_submit_and_wait(struct uring *ring, unsigned wait_nr)
+{
+	unsigned to_submit = ring->sq_local_tail - *ring->sq_tail;
+
+	/* The entries must be visible before the kernel sees the new tail */
+	__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+	return io_uring_enter(ring->fd, to_submit, wait_nr,
+			      wait_nr ? IORING_ENTER_GETEVENTS : 0);
+}
+
+struct io_uring_cqe *uring_peek_cqe(struct uring *ring)
+{
+	unsigned head = *ring->cq_head;
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return NULL;
+	return &ring->cqes[head & *ring->cq_mask];
+}
+
+void uring_cqe_seen(struct uring *ring)
+{
+	__atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <linux/io_uring.h>
+
+/*
+ * An io_uring instance, with its submission and completion rings mapped.
+ * This is just enough of what liburing provides for rproc-example-host.
+ */
+struct uring {
+	int fd;
+
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned sq_local_tail;		/* Queued but not yet submitted */
+	unsigned sq_entries;
+
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+/* \return 0 on success, else -1 with errno set */
+int uring_init(struct uring *ring, unsigned entries);
+void uring_exit(struct uring *ring);
+
+/* Register an array of buffers for use by READ_FIXED / WRITE_FIXED */
+int uring_register_buffers(struct uring *ring, const struct iovec *iov, unsigned nr);
+/* Register an array of files, used by index with IOSQE_FIXED_FILE */
+int uring_register_files(struct uring *ring, const int *fds, unsigned nr);
+
+/* \return a cleared submission queue entry, or NULL if the ring is full */
+struct io_uring_sqe *uring_get_sqe(struct uring *ring);
+
+/*
+ * Submit the queued entries and wait for at least wait_nr completions, in
+ * a single system call.
+ * \return number submitted, or -1 with errno set
+ */
+int uring_submit_and_wait(struct uring *ring, unsigned wait_nr);
+
+/* \return the oldest completion, or NULL if there are none */
+struct io_uring_cqe *uring_peek_cqe(struct uring *ring);
+/* Mark the completion returned by uring_peek_cqe as consumed */
+void uring_cqe_seen(struct uring *ring);
+
+#endif /* __URING_H__ */
@@ -0,0 +1,567 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Decode the binary TRACE() records written by the firmware into its trace
+ * buffer (see firmware/common/include/trace.h), using the format strings in
+ * the trace_fmt section of the firmware ELF. Any printf() text in the buffer
+ * is passed through unchanged.
+ *
+ * The trace buffer is a ring following a header, which gives the position and
+ * wrap count of the ring. This is used to decode the ring from its oldest
+ * byte, and with -f to keep polling it and decode only what is new each time.
+ * The header is read on its own until it is stable, before the data it
+ * covers, since the firmware may be updating it as it is read.
+ */
+
+#include <elf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* From firmware/common/include/trace.h */
+#define TRACE_RECORD_START	0x1e
+#define TRACE_MAX_ARGS		7
+
+#define TRACE_HDR_SIZE		3
+#define TRACE_HDR_POSITION	6
+#define TRACE_HDR_WRAP		9
+#define TRACE_HDR_SEQ		13
+#define TRACE_HEADER_SIZE	15
+
+/* Reads of the header to make before giving up on it settling */
+#define HEADER_TRIES		1000
+
+/* How often to poll the trace buffer with -f */
+#define FOLLOW_INTERVAL_US	100000
+
+#define DEFAULT_TRACE "/sys/kernel/debug/remoteproc/remoteproc0/trace0"
+
+/* Format strings from the firmware ELF */
+static char *fmts;
+static size_t fmts_size;
+
+/* Size of a firmware long, in bits */
+static int long_bits = 32;
+
+/* Decoder state carried between reads of the trace buffer */
+static uint64_t last_timestamp;
+static int line_start = 1;
+static int resync;		/* Data starts part way through a line or record */
+
+static void print_usage_exit(char *name)
+{
+	printf("Usage: %s [-e <firmware>] [-t <trace>] [-f]\n", name);
+	printf("  -e <firmware> Firmware ELF image the trace was written by\n");
+	printf("  -t <trace> Trace buffer to decode (default %s)\n", DEFAULT_TRACE);
+	printf("  -f Follow the trace buffer, decoding new data as it is written\n");
+
+	exit(-1);
+}
+
+static void *read_file(const char *name, size_t *size)
+{
+	size_t len = 0, alloc = 0x10000, n;
+	char *buf = NULL;
+	FILE *f;
+
+	f = fopen(name, "rb");
+	if (!f) {
+		perror(name);
+		exit(-1);
+	}
+
+	do {
+		alloc *= 2;
+		buf = realloc(buf, alloc + 1);
+		if (!buf) {
+			perror("Allocating buffer");
+			exit(-1);
+		}
+		n = fread(buf + len, 1, alloc - len, f);
+		len += n;
+	} while (len == alloc);
+
+	fclose(f);
+	buf[len] = '\0';
+	*size = len;
+	return buf;
+}
+
+/* ELF fields in the byte order of the firmware */
+static int elf_swap;
+
+static uint64_t elf_get(const void *p, int size)
+{
+	const uint8_t *b = p;
+	uint64_t v = 0;
+	int i;
+
+	for (i = 0; i < size; i++) {
+		if (elf_swap)
+			v = v << 8 | b[i];
+		else
+			v |= (uint64_t)b[i] << (8 * i);
+	}
+	return v;
+}
+
+#define ELF_GET(s, m)	elf_get(&(s)->m, sizeof((s)->m))
+
+/* Get the name, file offset and size of section i of the ELF at elf */
+static void elf_section(char *elf, int is64, uint64_t shoff, unsigned int shentsize,
+			unsigned int i, unsigned int *name, uint64_t *offset, uint64_t *size)
+{
+	void *shdr = elf + shoff + (uint64_t)i * shentsize;
+
+	if (is64) {
+		Elf64_Shdr *s = shdr;
+
+		*name = ELF_GET(s, sh_name);
+		*offset = ELF_GET(s, sh_offset);
+		*size = ELF_GET(s, sh_size);
+	} else {
+		Elf32_Shdr *s = shdr;
+
+		*name = ELF_GET(s, sh_name);
+		*offset = ELF_GET(s, sh_offset);
+		*size = ELF_GET(s, sh_size);
+	}
+}
+
+/* Find the trace_fmt section of the firmware ELF */
+static void load_formats(const char *name)
+{
+	uint64_t shoff, offset, size, strtab, strtab_size;
+	unsigned int shentsize, shnum, shstrndx, i, sh_name;
+	size_t len;
+	char *elf;
+	int is64;
+
+	elf = read_file(name, &len);
+	if (len < EI_NIDENT || memcmp(elf, ELFMAG, SELFMAG)) {
+		fprintf(stderr, "%s is not an ELF file\n", name);
+		exit(-1);
+	}
+
+	is64 = elf[EI_CLASS] == ELFCLASS64;
+	long_bits = is64 ? 64 : 32;
+	elf_swap = elf[EI_DATA] == ELFDATA2MSB;
+
+	if (is64) {
+		Elf64_Ehdr *ehdr = (void *)elf;
+
+		shoff = ELF_GET(ehdr, e_shoff);
+		shentsize = ELF_GET(ehdr, e_shentsize);
+		shnum = ELF_GET(ehdr, e_shnum);
+		shstrndx = ELF_GET(ehdr, e_shstrndx);
+	} else {
+		Elf32_Ehdr *ehdr = (void *)elf;
+
+		shoff = ELF_GET(ehdr, e_shoff);
+		shentsize = ELF_GET(ehdr, e_shentsize);
+		shnum = ELF_GET(ehdr, e_shnum);
+		shstrndx = ELF_GET(ehdr, e_shstrndx);
+	}
+
+	if (shoff + (uint64_t)shnum * shentsize > len || shstrndx >= shnum)
+		goto bad;
+
+	/* Section names are in the section name string table */
+	elf_section(elf, is64, shoff, shentsize, shstrndx, &sh_name, &strtab, &strtab_size);
+	if (strtab + strtab_size > len)
+		goto bad;
+
+	for (i = 0; i < shnum; i++) {
+		elf_section(elf, is64, shoff, shentsize, i, &sh_name, &offset, &size);
+
+		if (sh_name >= strtab_size || strcmp(elf + strtab + sh_name, "trace_fmt"))
+			continue;
+		if (offset + size > len)
+			goto bad;
+
+		fmts = elf + offset;
+		fmts_size = size;
+		return;
+	}
+
+	fprintf(stderr, "%s has no trace_fmt section\n", name);
+	exit(-1);
+bad:
+	fprintf(stderr, "%s is truncated\n", name);
+	exit(-1);
+}
+
+/*
+ * Decode a value from the trace
+ * \return pointer past the value, or NULL if it is incomplete
+ */
+static const uint8_t *decode_value(const uint8_t *p, const uint8_t *end, uint64_t *value)
+{
+	int shift = 0;
+
+	*value = 0;
+	for (; p < end; p++, shift += 7) {
+		if ((*p & 0xc0) == 0x40) {
+			*value |= (uint64_t)(*p & 0x3f) << shift;
+			return p + 1;
+		}
+		if (!(*p & 0x80))
+			return NULL;
+		*value |= (uint64_t)(*p & 0x7f) << shift;
+	}
+	return NULL;
+}
+
+/* Print fmt, taking the argument to each conversion from args */
+static void print_record(const char *fmt, const uint64_t *args, int nargs)
+{
+	char spec[32];
+	int len, arg = 0;
+	uint64_t v;
+
+	while (*fmt) {
+		if (*fmt != '%') {
+			putchar(*fmt++);
+			continue;
+		}
+		if (fmt[1] == '%') {
+			putchar('%');
+			fmt += 2;
+			continue;
+		}
+
+		/* Copy flags, width and precision, dropping any length */
+		len = 0;
+		spec[len++] = *fmt++;
+		while (*fmt && strchr("-+ #0123456789.", *fmt) && len < sizeof(spec) - 4)
+			spec[len++] = *fmt++;
+		while (*fmt && strchr("hlLqjzt", *fmt))
+			fmt++;
+		if (!*fmt)
+			break;
+
+		if (arg >= nargs) {
+			printf("<missing>");
+			fmt++;
+			continue;
+		}
+		v = args[arg++];
+
+		switch (*fmt) {
+		case 'd':
+		case 'i':
+			/* Sign extend from a firmware long */
+			if (long_bits < 64 && (v & (1ULL << (long_bits - 1))))
+				v |= ~0ULL << long_bits;
+			strcpy(spec + len, "lld");
+			printf(spec, (long long)v);
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+			if (long_bits < 64)
+				v &= (1ULL << long_bits) - 1;
+			spec[len] = 'l';
+			spec[len + 1] = 'l';
+			spec[len + 2] = *fmt;
+			spec[len + 3] = '\0';
+			printf(spec, (unsigned long long)v);
+			break;
+		case 'c':
+			strcpy(spec + len, "c");
+			printf(spec, (int)v);
+			break;
+		default:
+			/* Pointers, and strings which can't be followed */
+			printf("0x%llx", (unsigned long long)v);
+			break;
+		}
+		fmt++;
+	}
+	putchar('\n');
+}
+
+/*
+ * Decode the record at p
+ * \return pointer past the record, or NULL if it is incomplete
+ */
+static const uint8_t *decode_record(const uint8_t *p, const uint8_t *end)
+{
+	uint64_t header, timestamp, args[TRACE_MAX_ARGS];
+	unsigned int id, nargs, i;
+
+	p = decode_value(p + 1, end, &header);
+	if (p)
+		p = decode_value(p, end, &timestamp);
+	if (!p)
+		return NULL;
+
+	id = header >> 3;
+	nargs = header & 7;
+	for (i = 0; i < nargs; i++) {
+		p = decode_value(p, end, &args[i]);
+		if (!p)
+			return NULL;
+	}
+
+	/* Timestamps are CP0 Count, which is 32 bits */
+	printf("[%10u +%8u] ", (uint32_t)timestamp,
+	       last_timestamp ? (uint32_t)(timestamp - last_timestamp) : 0);
+	last_timestamp = timestamp;
+
+	if (!fmts) {
+		printf("<format 0x%x>", id);
+		for (i = 0; i < nargs; i++)
+			printf(" 0x%llx", (unsigned long long)args[i]);
+		putchar('\n');
+	} else if (id >= fmts_size || !memchr(fmts + id, '\0', fmts_size - id)) {
+		printf("<unknown format 0x%x>\n", id);
+	} else {
+		print_record(fmts + id, args, nargs);
+	}
+	return p;
+}
+
+/* Decode trace data, which is text with records mixed in */
+static void decode(const uint8_t *p, const uint8_t *end)
+{
+	const uint8_t *next;
+
+	/* Skip to the start of the next record or line */
+	while (resync && p < end) {
+		if (*p == TRACE_RECORD_START)
+			resync = 0;
+		else if (*p++ == '\n')
+			resync = 0;
+	}
+
+	while (p < end) {
+		if (*p != TRACE_RECORD_START) {
+			/* printf text, or the tail of a record overwritten by a wrap */
+			if (*p < 0x80) {
+				putchar(*p);
+				line_start = *p == '\n';
+			}
+			p++;
+			continue;
+		}
+
+		if (!line_start)
+			putchar('\n');
+		line_start = 1;
+
+		next = decode_record(p, end);
+		if (!next) {
+			printf("<truncated record>\n");
+			p++;
+			continue;
+		}
+		p = next;
+	}
+}
+
+/* Get a number from the trace buffer header */
+static int header_get(const uint8_t *p, int bytes, unsigned int *value)
+{
+	int i;
+
+	*value = 0;
+	for (i = 0; i < bytes; i++) {
+		if (!(p[i] & 0x80))
+			return 0;
+		*value |= (p[i] & 0x7f) << (7 * i);
+	}
+	return 1;
+}
+
+/*
+ * Parse the trace buffer header
+ * \param total	Total bytes ever written to the ring
+ * \return non-zero if buf starts with a valid header that the firmware
+ *         wasn't part way through updating
+ */
+static int parse_header(const uint8_t *buf, size_t len, unsigned int *size, uint64_t *total)
+{
+	unsigned int position, wrap, seq;
+
+	if (len < TRACE_HEADER_SIZE || memcmp(buf, "TRC", 3) ||
+	    !header_get(buf + TRACE_HDR_SIZE, 3, size) ||
+	    !header_get(buf + TRACE_HDR_POSITION, 3, &position) ||
+	    !header_get(buf + TRACE_HDR_WRAP, 4, &wrap) ||
+	    !header_get(buf + TRACE_HDR_SEQ, 1, &seq) ||
+	    (seq & 1) || !*size || position >= *size)
+		return 0;
+
+	*total = (uint64_t)wrap * *size + position;
+	return 1;
+}
+
+/*
+ * Read just the header of the trace buffer, until two reads running agree,
+ * including the sequence number, and it wasn't being updated
+ * \return non-zero for a stable, valid header
+ */
+static int read_header(const char *name, unsigned int *size, uint64_t *total)
+{
+	uint8_t buf[2][TRACE_HEADER_SIZE];
+	int i, n[2];
+	FILE *f;
+
+	for (i = 0; i < HEADER_TRIES; i++) {
+		f = fopen(name, "rb");
+		if (!f)
+			return 0;
+		n[i & 1] = fread(buf[i & 1], 1, TRACE_HEADER_SIZE, f);
+		fclose(f);
+
+		if (n[i & 1] < 3 || memcmp(buf[i & 1], "TRC", 3))
+			return 0;
+
+		if (i && n[0] == n[1] && !memcmp(buf[0], buf[1], n[0]) &&
+		    parse_header(buf[0], n[0], size, total))
+			return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *firmware = NULL, *trace = DEFAULT_TRACE;
+	uint64_t total, start, oldest, done = 0, check;
+	unsigned int size, check_size, i;
+	int c, follow = 0, first = 1, header;
+	uint8_t *buf, *data, *linear;
+	size_t len;
+
+	opterr = 0;
+	while ((c = getopt(argc, argv, "e:t:f")) != -1)
+	switch (c)
+	{
+	case 'e':
+		firmware = optarg;
+		break;
+	case 't':
+		trace = optarg;
+		break;
+	case 'f':
+		follow = 1;
+		break;
+	default:
+		print_usage_exit(argv[0]);
+	}
+
+	if (firmware)
+		load_formats(firmware);
+
+	while (1) {
+		/* The header first, so the data read after it covers total */
+		header = read_header(trace, &size, &total);
+		buf = read_file(trace, &len);
+
+		/* The trace is read as a string, so ends at the first NUL */
+		len = strnlen((const char *)buf, len);
+
+		if (first && (len < 3 || memcmp(buf, "TRC", 3))) {
+			/* A trace buffer without a header */
+			decode(buf, buf + len);
+			return 0;
+		}
+
+		if (!header || len < TRACE_HEADER_SIZE) {
+			/* The firmware is being restarted, or is busy updating it */
+			free(buf);
+			usleep(FOLLOW_INTERVAL_US);
+			continue;
+		}
+
+		data = buf + TRACE_HEADER_SIZE;
+		len -= TRACE_HEADER_SIZE;
+
+		/*
+		 * The oldest data may have been overwritten while it was read,
+		 * so check how far the firmware has got since
+		 */
+		if (!read_header(trace, &check_size, &check) || check_size != size || check < total)
+			check = total;
+		oldest = check > size ? check - size : 0;
+
+		if (first) {
+			start = total > size ? total - size : 0;
+			resync = start > 0;
+		} else {
+			start = done;
+		}
+
+		if (total < start) {
+			printf("<trace restarted>\n");
+			start = 0;
+		}
+		if (start < oldest) {
+			printf("<lost %llu bytes>\n", (unsigned long long)(oldest - start));
+			start = oldest;
+			resync = 1;
+		}
+		if (start > total)
+			start = total;
+
+		/* Unwrap the new data, which may straddle the end of the ring */
+		linear = malloc(total - start + 1);
+		for (i = 0; i < total - start; i++) {
+			unsigned int index = (start + i) % size;
+
+			linear[i] = index < len ? data[index] : 0;
+		}
+		decode(linear, linear + (total - start));
+		free(linear);
+		free(buf);
+
+		done = total;
+		first = 0;
+
+		if (!follow)
+			break;
+		fflush(stdout);
+		usleep(FOLLOW_INTERVAL_US);
+	}
+
+	return 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Remote processor side of the simulation. It runs the service loop of the
+ * case_invert firmware (firmware/case_invert/service.c), built natively, with
+ * the platform functions main.c provides on hardware replaced. The GIC IPIs
+ * are replaced by the simulated ones, CP0 Count by a nanosecond clock, and the
+ * KSEG0/KSEG1 offsets by an identity mapping, since the simulated host hands
+ * out directly addressable buffers.
+ */
+
+#include <bulk.h>
+#include <console.h>
+#include <printf.h>
+#include <rpmsg.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <trace.h>
+#include <unistd.h>
+
+#include "service.h"
+#include "sim.h"
+
+/* Is the interrupt associated with host -> remote asserted? */
+int irq_from_host(void)
+{
+	if (__atomic_exchange_n(&sim.kick, 0, __ATOMIC_ACQ_REL))
+		return 1;
+
+	/* Let the host thread run if we share a CPU with it */
+	sched_yield();
+	return 0;
+}
+
+/* Assert the interrupt associated with remote -> host */
+void irq_to_host(void)
+{
+	TRACE("Asserting IRQ");
+	__atomic_fetch_add(&sim.irqs, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * The simulated interrupt is only taken in sim_wait_for_irq, which the main
+ * loop calls in the modes that unmask it on hardware
+ */
+void mask_irq_from_host(void)
+{
+}
+
+void unmask_irq_from_host(void)
+{
+}
+
+unsigned int read_count(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void poll_idle(void)
+{
+	/* Let the host thread run if we share a CPU with it */
+	sched_yield();
+}
+
+/*
+ * Sleep until the host -> remote interrupt is asserted, as the firmware does
+ * in WAIT with the interrupt unmasked
+ */
+static void sim_wait_for_irq(void)
+{
+	__atomic_store_n(&sim.irq_enabled, 1, __ATOMIC_SEQ_CST);
+	while (!__atomic_load_n(&sim.kick, __ATOMIC_SEQ_CST) &&
+	       !__atomic_load_n(&sim.stop, __ATOMIC_SEQ_CST))
+		syscall(SYS_futex, &sim.kick, FUTEX_WAIT, 0, NULL, NULL, 0);
+	__atomic_store_n(&sim.irq_enabled, 0, __ATOMIC_SEQ_CST);
+}
+
+void *sim_firmware_main(void *arg)
+{
+	/* Start with the configuration the host has left */
+	service_init(&sim.serial_rsc.vdev, &sim.rpmsg_rsc.vdev, &sim.config, 0, 0);
+	console_set_packed(&console, sim.packed);
+
+	if (sim.bulk)
+		/* The simulated host maps the carveout once the header is written */
+		bulk_init(&bulk, &sim.bulk_rsc, sim.bulk_slot_size);
+
+	while (!__atomic_load_n(&sim.stop, __ATOMIC_ACQUIRE)) {
+		switch (config.mode) {
+		case FW_MODE_POLLED:
+			check_and_handle_incoming_buffers();
+			break;
+		case FW_MODE_HYBRID:
+			if (polling) {
+				poll_incoming_buffers();
+				break;
+			}
+			/* Fall through - wait for the interrupt */
+		default:
+			sim_wait_for_irq();
+			handle_interrupt();
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+int putchar(char c)
+{
+	/* Printf should be directed to the trace buffer */
+	trace_putc(c);
+	return c;
+}
+
+void printf_write(const char *s, int len)
+{
+	trace_puts(s, len);
+}
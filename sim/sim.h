@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <stdint.h>
+
+#include <asm/remoteproc.h>
+#include <console.h>
+#include <fw_config.h>
+
+#include "service.h"
+
+/*
+ * From linux/futex.h, which can't be included as the firmware asm/types.h
+ * hides the kernels
+ */
+#define FUTEX_WAIT		0
+#define FUTEX_WAKE		1
+
+/*
+ * State shared between the simulated host (Linux virtio driver) and the
+ * simulated remote processor. In the real system the vdev resources live in
+ * the firmware resource table and the notifications are GIC IPIs.
+ */
+struct sim_state {
+	/*
+	 * Filled in by the host, as Linux does for the resource table. The
+	 * vdev the messages are exchanged on has DRIVER_OK set, the other is
+	 * left alone.
+	 */
+	volatile struct {
+		struct fw_rsc_vdev vdev;
+		struct fw_rsc_vdev_vring vring[CONSOLE_NUM_VRINGS(NUM_PORTS)];
+	} __packed serial_rsc;
+	uint32_t gfeatures;		/* Negotiated virtio features */
+
+	int kick;			/* Host -> firmware IPI pending */
+	unsigned long kicks;		/* Host -> firmware IPIs sent */
+	unsigned long irqs;		/* Firmware -> host IPIs sent */
+	int stop;			/* Ask the firmware thread to exit */
+
+	/* With rpmsg set, messages go over this vdev rather than the serial port */
+	int rpmsg;
+	volatile struct {
+		struct fw_rsc_vdev vdev;
+		struct fw_rsc_vdev_vring vring[2];
+	} __packed rpmsg_rsc;
+
+	/*
+	 * With bulk set, rpmsg carries descriptors of slots in this carveout,
+	 * laid out by the firmware in slots of bulk_slot_size bytes (a build
+	 * time choice on hardware)
+	 */
+	int bulk;
+	volatile struct fw_rsc_carveout bulk_rsc;
+	uint32_t bulk_slot_size;
+
+	int packed;			/* The vrings use the packed layout */
+
+	/*
+	 * Written by the host, as Linux may write the configuration block in
+	 * the vdev resource, and re-read by the firmware on each kick. The
+	 * poll budget is in ns.
+	 */
+	volatile struct fw_config config;
+	int irq_enabled;		/* Firmware is waiting for a kick */
+};
+
+extern struct sim_state sim;
+
+/*
+ * Firmware thread entry point
+ */
+void *sim_firmware_main(void *arg);
+
+#endif /* _SIM_H_ */
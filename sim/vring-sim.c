@@ -0,0 +1,1087 @@
+/*
+ * Copyright (c) 2016, Imagination Technologies LLC and Imagination
+ * Technologies Limited.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions in binary form must be built to execute on machines
+ *    implementing the MIPS32(R), MIPS64 and/or microMIPS instruction set
+ *    architectures.
+ *
+ * 2. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 3. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 4. Neither the name of Imagination Technologies LLC, Imagination
+ *    Technologies Limited nor the names of its contributors may be used to
+ *    endorse or promote products derived from this software without specific
+ *    prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL IMAGINATION TECHNOLOGIES LLC OR
+ * IMAGINATION TECHNOLOGIES LIMITED BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+ * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Hosted simulation of the remote processor vring path.
+ *
+ * The service loop of the case_invert firmware and the common code under it
+ * are built natively and driven from one thread as the remote processor,
+ * while this file plays the part of the Linux virtio driver on another
+ * thread. The vrings are laid out in memory exactly as the kernel allocates
+ * them for a fw_rsc_vdev_vring resource, so the firmware sees the same
+ * structures as on real hardware.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <rpmsg.h>
+#include <trace.h>
+#include <vring.h>
+
+#include "bulk-map.h"
+#include "sim.h"
+
+#define VRING_ALIGN		0x1000
+
+/* Virtio device ID of the serial port, as linux/virtio_ids.h */
+#define VIRTIO_ID_RPROC_SERIAL	11
+
+/* Address of the host rpmsg endpoint, as Linux allocates them */
+#define HOST_RPMSG_ADDR		(RPMSG_RESERVED_ADDRESSES + 1)
+
+/* Addresses of the case inversion and bulk slots endpoints in the firmware */
+#define INVERT_RPMSG_ADDR	RPMSG_RESERVED_ADDRESSES
+#define SLOTS_RPMSG_ADDR	(RPMSG_RESERVED_ADDRESSES + 1)
+
+/* Endpoints the firmware announces, in address order */
+static const char *const rpmsg_names[] = {
+	"rpmsg-case-invert",
+	"rpmsg-case-invert-slots",
+};
+
+/* Descriptors and buffer size of the control vrings, with -M */
+#define CTRL_NUM		8
+#define CTRL_BUF_SIZE		0x1000
+
+/* Give up if the firmware makes no progress for this long */
+#define STALL_TIMEOUT_NS	1000000000ULL
+
+struct sim_state sim;
+
+/* The host (virtio driver) view of a vring */
+struct host_vq {
+	unsigned int num;
+	volatile struct vring_desc *desc;	/* Private shadow if packed */
+	volatile struct vring_avail *avail;
+	volatile struct vring_used *used;
+
+	volatile uint16_t *used_event;	/* Firmware: notify me at this used index */
+	volatile uint16_t *avail_event;	/* Us: notify me at this avail index */
+	int event_idx;			/* VIRTIO_RING_F_EVENT_IDX negotiated */
+
+	uint16_t avail_index;		/* Next available ring index to publish */
+	uint16_t avail_published;	/* Available ring index last published */
+	uint16_t used_index;		/* Next used ring entry to consume */
+
+	uint16_t *free;			/* Stack of free descriptor indexes */
+	unsigned int num_free;
+
+	uint8_t *bufs;			/* One buffer per descriptor */
+	unsigned int buf_size;
+
+	uint8_t *indirect;		/* Indirect table and buffers per descriptor */
+	unsigned int indirect_size;
+
+	/*
+	 * Packed layout. Chains are built in the shadow desc table as for the
+	 * split layout, then copied into the ring by host_vq_add. avail_index
+	 * and used_index are then positions in the ring.
+	 */
+	int packed;
+	volatile struct vring_packed_desc *packed_desc;
+	volatile struct vring_packed_event *driver_event; /* Us: notify me */
+	volatile struct vring_packed_event *device_event; /* Firmware: notify me */
+	uint16_t avail_wrap, used_wrap;	/* Wrap counters */
+	unsigned int avail_added;	/* Descriptors added since last publish */
+	uint16_t batch_index;		/* First descriptor added since publish */
+	uint16_t batch_flags;		/* Its flags, written when published */
+	uint16_t *chain_descs;		/* Descriptors in each buffers chain */
+};
+
+static void print_usage_exit(char *name)
+{
+	printf("Usage: %s [-n <messages>] [-s <size>] [-r <num>] [-d <depth>] [-g <segs>] [-i] [-k] [-m <mode>] [-p <budget>] [-c <n>] [-l <level>] [-M] [-R] [-b] [-e] [-t <file>]\n", name);
+	printf("  -n <messages> Number of messages to echo (default 100000)\n");
+	printf("  -s <size> Message size in bytes (default 64)\n");
+	printf("  -r <num> Descriptors per vring, power of two (default 4)\n");
+	printf("  -d <depth> Messages in flight (default and maximum <num> / <segs>)\n");
+	printf("  -g <segs> Send each message as a chain of <segs> descriptors\n");
+	printf("  -i Send chained messages with VIRTIO_RING_F_INDIRECT_DESC\n");
+	printf("  -k Use the packed vring layout (VIRTIO_F_RING_PACKED)\n");
+	printf("  -m <mode> Service buffers interrupt driven (0), polled (1, default) or hybrid (2)\n");
+	printf("  -p <budget> Hybrid interrupt/poll servicing, polling for <budget> ns\n");
+	printf("  -c <n> Move the firmware on to the next mode every <n> messages\n");
+	printf("  -l <level> Firmware trace level (0 none, 1 printf, 2 all, default)\n");
+	printf("  -M Negotiate VIRTIO_CONSOLE_F_MULTIPORT and set the port up over the control vrings\n");
+	printf("  -R Send messages over rpmsg to the case inversion endpoint\n");
+	printf("  -b Send messages in slots of a bulk carveout, passing only their descriptors\n");
+	printf("     over rpmsg to the bulk slots endpoint\n");
+	printf("  -e Don't negotiate VIRTIO_RING_F_EVENT_IDX\n");
+	printf("  -t <file> Write the firmware trace buffer to <file> on exit\n");
+
+	exit(-1);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Size of a vring as allocated by Linux (vring_size() in virtio_ring.h), or
+ * of a packed ring followed by its two event suppression structures
+ */
+static size_t host_vq_size(unsigned int num)
+{
+	size_t size;
+
+	if (sim.packed)
+		return sizeof(struct vring_packed_desc) * num +
+		       sizeof(struct vring_packed_event) * 2;
+
+	size = sizeof(struct vring_desc) * num + sizeof(uint16_t) * (3 + num);
+	size = (size + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1);
+	return size + sizeof(uint16_t) * 3 + sizeof(struct vring_used_entry) * num;
+}
+
+/* Lay out a vring as Linux does (vring_init() in virtio_ring.h) */
+static void host_vq_init(struct host_vq *vq, void *mem, unsigned int num,
+			 uint8_t *bufs, unsigned int buf_size)
+{
+	uintptr_t used;
+	unsigned int i;
+
+	memset(mem, 0, host_vq_size(num));
+
+	vq->num = num;
+	vq->desc = mem;
+	vq->avail = mem + num * sizeof(struct vring_desc);
+	vq->used_event = (void *)vq->avail + sizeof(struct vring_avail) + num * sizeof(uint16_t);
+	used = (uintptr_t)vq->used_event + sizeof(uint16_t);
+	vq->used = (void *)((used + VRING_ALIGN - 1) & ~(uintptr_t)(VRING_ALIGN - 1));
+	vq->avail_event = (void *)vq->used + sizeof(struct vring_used) + num * sizeof(struct vring_used_entry);
+	vq->event_idx = !!(sim.gfeatures & (1 << VIRTIO_RING_F_EVENT_IDX));
+
+	vq->avail_index = vq->avail_published = vq->used_index = 0;
+
+	vq->free = calloc(num, sizeof(*vq->free));
+	for (i = 0; i < num; i++)
+		vq->free[i] = num - 1 - i;
+	vq->num_free = num;
+
+	vq->bufs = bufs;
+	vq->buf_size = buf_size;
+	vq->indirect = NULL;
+
+	vq->packed = sim.packed;
+	if (vq->packed) {
+		vq->packed_desc = mem;
+		vq->driver_event = mem + num * sizeof(struct vring_packed_desc);
+		vq->device_event = vq->driver_event + 1;
+		vq->avail_wrap = vq->used_wrap = 1;
+		vq->avail_added = 0;
+		vq->chain_descs = calloc(num, sizeof(*vq->chain_descs));
+
+		/* The firmware only sees the ring, not the shadow descriptors */
+		vq->desc = calloc(num, sizeof(struct vring_desc));
+		vq->avail = NULL;
+		vq->used = NULL;
+	}
+}
+
+/* Move a packed ring position on by count descriptors */
+static void host_vq_packed_advance(struct host_vq *vq, uint16_t *index, uint16_t *wrap,
+				   unsigned int count)
+{
+	*index += count;
+	if (*index >= vq->num) {
+		*index -= vq->num;
+		*wrap ^= 1;
+	}
+}
+
+/*
+ * Copy the shadow chain at head into the packed ring. The flags of the first
+ * descriptor added since the last publish are held back, so the firmware sees
+ * none of the batch until it is published.
+ */
+static void host_vq_add_packed(struct host_vq *vq, unsigned int head)
+{
+	volatile struct vring_packed_desc *desc;
+	unsigned int id = head, count = 0;
+	uint16_t flags;
+
+	while (1) {
+		desc = &vq->packed_desc[vq->avail_index];
+		desc->address = vq->desc[id].address;
+		desc->length = vq->desc[id].length;
+		desc->id = head;
+
+		flags = vq->desc[id].flags;
+		flags |= vq->avail_wrap ? 1 << VRING_PACKED_DESC_F_AVAIL :
+					  1 << VRING_PACKED_DESC_F_USED;
+
+		if (!vq->avail_added && !count) {
+			vq->batch_index = vq->avail_index;
+			vq->batch_flags = flags;
+		} else {
+			desc->flags = flags;
+		}
+
+		count++;
+		host_vq_packed_advance(vq, &vq->avail_index, &vq->avail_wrap, 1);
+		if (!(vq->desc[id].flags & VRING_DESC_F_NEXT))
+			break;
+		id = vq->desc[id].next;
+	}
+
+	vq->chain_descs[head] = count;
+	vq->avail_added += count;
+}
+
+static uint8_t *host_vq_buf(struct host_vq *vq, unsigned int id)
+{
+	return vq->bufs + id * vq->buf_size;
+}
+
+/* Point descriptor id at its buffer */
+static void host_vq_set_desc(struct host_vq *vq, unsigned int id, unsigned int len,
+			     unsigned int flags, unsigned int next)
+{
+	vq->desc[id].address = (uintptr_t)host_vq_buf(vq, id);
+	vq->desc[id].length = len;
+	vq->desc[id].flags = flags;
+	vq->desc[id].next = next;
+}
+
+/* Place the chain at head on the available ring. Not visible until published */
+static void host_vq_add(struct host_vq *vq, unsigned int head)
+{
+	if (vq->packed) {
+		host_vq_add_packed(vq, head);
+		return;
+	}
+
+	vq->avail->ring[vq->avail_index & (vq->num - 1)] = head;
+	vq->avail_index++;
+}
+
+/* Return every descriptor in the chain at head to the free stack */
+static void host_vq_free_chain(struct host_vq *vq, unsigned int head)
+{
+	unsigned int id = head;
+
+	while (1) {
+		vq->free[vq->num_free++] = id;
+		if (!(vq->desc[id].flags & VRING_DESC_F_NEXT))
+			break;
+		id = vq->desc[id].next;
+	}
+}
+
+/*
+ * Make buffers added since the last call visible to the firmware
+ * \return non-zero if the firmware needs to be kicked
+ */
+static int host_vq_publish_packed(struct host_vq *vq)
+{
+	uint16_t new = vq->avail_index;
+	uint16_t old = new - vq->avail_added;
+	uint16_t off_wrap, event;
+	int flags;
+
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	if (vq->avail_added)
+		vq->packed_desc[vq->batch_index].flags = vq->batch_flags;
+	vq->avail_added = 0;
+
+	/* Order the descriptor updates before reading the firmwares event */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	flags = vq->device_event->flags;
+	if (flags != VRING_PACKED_EVENT_FLAG_DESC)
+		return flags != VRING_PACKED_EVENT_FLAG_DISABLE;
+
+	off_wrap = vq->device_event->off_wrap;
+	event = off_wrap & ~(1 << VRING_PACKED_EVENT_F_WRAP_CTR);
+	if ((off_wrap >> VRING_PACKED_EVENT_F_WRAP_CTR) != vq->avail_wrap)
+		event -= vq->num;
+
+	return (uint16_t)(new - event - 1) < (uint16_t)(new - old);
+}
+
+static int host_vq_publish(struct host_vq *vq)
+{
+	uint16_t old = vq->avail_published;
+	uint16_t new = vq->avail_index;
+
+	if (vq->packed)
+		return host_vq_publish_packed(vq);
+
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	vq->avail->index = new;
+	vq->avail_published = new;
+
+	/* Order the avail index update before reading the firmwares flags */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (!vq->event_idx)
+		return !(vq->used->flags & VRING_USED_F_NO_NOTIFY);
+
+	return (uint16_t)(new - *vq->avail_event - 1) < (uint16_t)(new - old);
+}
+
+/* Retrieve the next entry from the used ring, if there is one */
+static int host_vq_get_used(struct host_vq *vq, unsigned int *id, unsigned int *len)
+{
+	volatile struct vring_used_entry *entry;
+
+	if (vq->packed) {
+		volatile struct vring_packed_desc *desc = &vq->packed_desc[vq->used_index];
+		uint16_t flags = desc->flags;
+
+		if (!!(flags & (1 << VRING_PACKED_DESC_F_AVAIL)) != vq->used_wrap ||
+		    !!(flags & (1 << VRING_PACKED_DESC_F_USED)) != vq->used_wrap)
+			return 0;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		*id = desc->id;
+		*len = desc->length;
+		host_vq_packed_advance(vq, &vq->used_index, &vq->used_wrap,
+				       vq->chain_descs[*id]);
+		return 1;
+	}
+
+	if (vq->used_index == vq->used->index)
+		return 0;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	entry = &vq->used->ring[vq->used_index & (vq->num - 1)];
+	*id = entry->index;
+	*len = entry->length;
+	vq->used_index++;
+	return 1;
+}
+
+/* Ask the firmware to notify us when it next uses a buffer */
+static void host_vq_enable_cb(struct host_vq *vq)
+{
+	if (vq->packed) {
+		if (vq->event_idx) {
+			vq->driver_event->off_wrap = vq->used_index |
+				vq->used_wrap << VRING_PACKED_EVENT_F_WRAP_CTR;
+			vq->driver_event->flags = VRING_PACKED_EVENT_FLAG_DESC;
+		}
+		return;
+	}
+
+	if (vq->event_idx)
+		*vq->used_event = vq->used_index;
+}
+
+static void kick_firmware(void)
+{
+	__atomic_store_n(&sim.kick, 1, __ATOMIC_SEQ_CST);
+	sim.kicks++;
+
+	/* Wake the firmware if it is waiting for the interrupt */
+	if (__atomic_load_n(&sim.irq_enabled, __ATOMIC_SEQ_CST))
+		syscall(SYS_futex, &sim.kick, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/* The bulk carveout, mapped as user space maps it, with -b */
+static struct bulk_map bulk_map;
+
+static const char message_chars[] =
+	"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 .";
+
+static void fill_message(uint8_t *buf, unsigned int len, unsigned long seq)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = message_chars[(seq + i) % (sizeof(message_chars) - 1)];
+}
+
+/*
+ * Write message seq into a chain of segs descriptors and place it on the
+ * available ring. If the ring has indirect tables, the chain is written into
+ * the indirect table of a single descriptor.
+ */
+static void send_message(struct host_vq *vq, unsigned int size, unsigned int segs,
+			 unsigned long seq)
+{
+	unsigned int seg_size = (size + segs - 1) / segs;
+	unsigned int id, next = 0, offset, len, i;
+	struct vring_desc *table;
+	struct rpmsg_hdr *hdr;
+	uint8_t *buf;
+
+	if (sim.rpmsg) {
+		/* A single buffer, with the data after the rpmsg header */
+		id = vq->free[--vq->num_free];
+		hdr = (void *)host_vq_buf(vq, id);
+		hdr->src = HOST_RPMSG_ADDR;
+		hdr->reserved = 0;
+		hdr->flags = 0;
+
+		if (sim.bulk) {
+			/* The message goes in a slot, and only its descriptor over rpmsg */
+			struct bulk_desc *desc = (void *)hdr->data;
+
+			desc->slot = bulk_map_alloc(&bulk_map);
+			desc->len = size;
+			fill_message(bulk_map_slot(&bulk_map, desc->slot), size, seq);
+			hdr->dst = SLOTS_RPMSG_ADDR;
+			hdr->len = sizeof(*desc);
+		} else {
+			fill_message(hdr->data, size, seq);
+			hdr->dst = INVERT_RPMSG_ADDR;
+			hdr->len = size;
+		}
+
+		host_vq_set_desc(vq, id, sizeof(*hdr) + hdr->len, 0, 0);
+		host_vq_add(vq, id);
+		return;
+	}
+
+	if (vq->indirect) {
+		id = vq->free[--vq->num_free];
+		table = (void *)(vq->indirect + id * vq->indirect_size);
+		buf = (uint8_t *)&table[segs];
+
+		for (i = 0; i < segs; i++, buf += seg_size) {
+			offset = i * seg_size;
+			len = offset >= size ? 0 : size - offset;
+			if (len > seg_size)
+				len = seg_size;
+
+			fill_message(buf, len, seq + offset);
+			if (vq->packed) {
+				/* Packed tables are walked in order, without next */
+				struct vring_packed_desc *ptable = (void *)table;
+
+				ptable[i].address = (uintptr_t)buf;
+				ptable[i].length = len;
+				ptable[i].id = 0;
+				ptable[i].flags = 0;
+				continue;
+			}
+			table[i].address = (uintptr_t)buf;
+			table[i].length = len;
+			table[i].flags = i == segs - 1 ? 0 : VRING_DESC_F_NEXT;
+			table[i].next = i + 1;
+		}
+
+		vq->desc[id].address = (uintptr_t)table;
+		vq->desc[id].length = segs * sizeof(struct vring_desc);
+		vq->desc[id].flags = VRING_DESC_F_INDIRECT;
+		vq->desc[id].next = 0;
+		host_vq_add(vq, id);
+		return;
+	}
+
+	/* Build the chain from the tail, so each descriptor knows its next */
+	for (i = segs; i-- > 0; ) {
+		offset = i * seg_size;
+		len = offset >= size ? 0 : size - offset;
+		if (len > seg_size)
+			len = seg_size;
+
+		id = vq->free[--vq->num_free];
+		fill_message(host_vq_buf(vq, id), len, seq + offset);
+		host_vq_set_desc(vq, id, len, i == segs - 1 ? 0 : VRING_DESC_F_NEXT, next);
+		next = id;
+	}
+	host_vq_add(vq, next);
+}
+
+static int check_response(const uint8_t *buf, unsigned int len, unsigned long seq)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		uint8_t c = message_chars[(seq + i) % (sizeof(message_chars) - 1)];
+
+		if (c >= 'a' && c <= 'z')
+			c -= 0x20;
+		else if (c >= 'A' && c <= 'Z')
+			c += 0x20;
+		if (buf[i] != c)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Check the rpmsg header of a response from the endpoint messages are sent
+ * to and find its data, or check the name service announcement of one of
+ * the firmware endpoints, marking it in announced
+ * \return 1 for a response, 0 for an announcement or -1 if either is wrong
+ */
+static int rpmsg_unwrap(uint8_t **buf, unsigned int *len, unsigned int *announced)
+{
+	struct rpmsg_hdr *hdr = (void *)*buf;
+	struct rpmsg_ns_msg *ns = (void *)hdr->data;
+	unsigned int i = hdr->src - RPMSG_RESERVED_ADDRESSES;
+
+	if (*len < sizeof(*hdr) || hdr->len != *len - sizeof(*hdr) ||
+	    i >= sizeof(rpmsg_names) / sizeof(rpmsg_names[0]))
+		return -1;
+
+	if (hdr->dst == RPMSG_NS_ADDR) {
+		if (hdr->len != sizeof(*ns) || ns->addr != hdr->src ||
+		    ns->flags != RPMSG_NS_CREATE || strcmp(ns->name, rpmsg_names[i]) ||
+		    (*announced & 1 << i))
+			return -1;
+		*announced |= 1 << i;
+		return 0;
+	}
+
+	if (hdr->dst != HOST_RPMSG_ADDR ||
+	    hdr->src != (sim.bulk ? SLOTS_RPMSG_ADDR : INVERT_RPMSG_ADDR))
+		return -1;
+
+	*buf = hdr->data;
+	*len = hdr->len;
+	return 1;
+}
+
+/*
+ * Check the descriptor returned for the oldest slot in flight, free the slot
+ * and find the response in it
+ * \return 1, or -1 if the descriptor is wrong
+ */
+static int bulk_unwrap(uint8_t **buf, unsigned int *len)
+{
+	struct bulk_desc *desc = (void *)*buf;
+
+	if (*len != sizeof(*desc) || bulk_map_free(&bulk_map, desc->slot))
+		return -1;
+
+	*buf = bulk_map_slot(&bulk_map, desc->slot);
+	*len = desc->len;
+	return 1;
+}
+
+/* Send a control message to the firmware, as __send_control_msg */
+static void send_control(struct host_vq *vq, uint32_t port, uint16_t event, uint16_t value)
+{
+	struct virtio_console_control *msg;
+	unsigned int id = vq->free[--vq->num_free];
+
+	msg = (void *)host_vq_buf(vq, id);
+	msg->id = port;
+	msg->event = event;
+	msg->value = value;
+
+	host_vq_set_desc(vq, id, sizeof(*msg), 0, 0);
+	host_vq_add(vq, id);
+	if (host_vq_publish(vq))
+		kick_firmware();
+}
+
+/*
+ * Set up every port over the control vrings, as virtio_console does once
+ * VIRTIO_CONSOLE_F_MULTIPORT has been negotiated: tell the firmware the
+ * driver is ready, answer each PORT_ADD with PORT_READY, check the name of
+ * each port and, once the firmware has opened it, open it from our side as
+ * user space opening the port would.
+ * \return 0, or -1 if a message is wrong or the firmware stalls
+ */
+static int console_setup(struct host_vq *ctrl_rx, struct host_vq *ctrl_tx)
+{
+	unsigned int added = 0, named = 0, opened = 0, all = (1 << NUM_PORTS) - 1;
+	struct virtio_console_control *msg;
+	uint64_t progress = now_ns();
+	unsigned int id, len;
+	const char *name;
+	int idle;
+
+	send_control(ctrl_tx, VIRTIO_CONSOLE_BAD_ID, VIRTIO_CONSOLE_DEVICE_READY, 1);
+
+	while (opened != all) {
+		idle = 1;
+
+		while (host_vq_get_used(ctrl_tx, &id, &len))
+			host_vq_free_chain(ctrl_tx, id);
+		host_vq_enable_cb(ctrl_tx);
+
+		while (host_vq_get_used(ctrl_rx, &id, &len)) {
+			msg = (void *)host_vq_buf(ctrl_rx, id);
+			name = (const char *)(msg + 1);
+			if (len < sizeof(*msg) || msg->id >= NUM_PORTS)
+				goto bad;
+
+			switch (msg->event) {
+			case VIRTIO_CONSOLE_PORT_ADD:
+				if (added & 1 << msg->id)
+					goto bad;
+				added |= 1 << msg->id;
+				send_control(ctrl_tx, msg->id, VIRTIO_CONSOLE_PORT_READY, 1);
+				break;
+
+			case VIRTIO_CONSOLE_PORT_NAME:
+				/* The name isn't terminated */
+				if (!(added & 1 << msg->id) || !ports[msg->id].name ||
+				    len - sizeof(*msg) != strlen(ports[msg->id].name) ||
+				    memcmp(name, ports[msg->id].name, len - sizeof(*msg)))
+					goto bad;
+				named |= 1 << msg->id;
+				break;
+
+			case VIRTIO_CONSOLE_PORT_OPEN:
+				if (!(added & 1 << msg->id) || !msg->value ||
+				    (ports[msg->id].name && !(named & 1 << msg->id)))
+					goto bad;
+				opened |= 1 << msg->id;
+				send_control(ctrl_tx, msg->id, VIRTIO_CONSOLE_PORT_OPEN, 1);
+				break;
+
+			default:
+				goto bad;
+			}
+
+			host_vq_set_desc(ctrl_rx, id, CTRL_BUF_SIZE, VRING_DESC_F_WRITE, 0);
+			host_vq_add(ctrl_rx, id);
+			idle = 0;
+		}
+		host_vq_enable_cb(ctrl_rx);
+		if (!idle && host_vq_publish(ctrl_rx))
+			kick_firmware();
+
+		if (idle) {
+			if (now_ns() - progress > STALL_TIMEOUT_NS) {
+				fprintf(stderr, "Firmware stalled setting up ports\n");
+				return -1;
+			}
+			sched_yield();
+		} else {
+			progress = now_ns();
+		}
+	}
+
+	return 0;
+
+bad:
+	fprintf(stderr, "Bad control message: id %u event %u value %u\n",
+		msg->id, msg->event, msg->value);
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long messages = 100000, sent = 0, received = 0;
+	unsigned int size = 64, num = 4, depth = 0, segs = 1, msg_descs, buf_size;
+	unsigned long cycle = 0;
+	int c, event_idx = 1, indirect = 0, multiport = 0, ret = 0;
+	unsigned int announced = 0;
+	const char *trace_file = NULL;
+	struct host_vq tx, rx, ctrl_tx, ctrl_rx;
+	uint64_t start, elapsed, progress;
+	size_t ring_size, ctrl_ring_size, len, bulk_len;
+	int bulk_fd = -1;
+	char bulk_path[32];
+	uint8_t *bulk_mem;
+	unsigned int i, id, used_len;
+	volatile struct fw_rsc_vdev *vdev;
+	volatile struct fw_rsc_vdev_vring *vrings;
+	pthread_t firmware;
+	uint8_t *mem;
+	double secs;
+
+	sim.config.mode = FW_MODE_POLLED;
+	sim.config.trace_level = TRACE_LEVEL_ALL;
+
+	opterr = 0;
+	while ((c = getopt(argc, argv, "n:s:r:d:g:ikm:p:c:l:MRbet:")) != -1)
+	switch (c)
+	{
+	case 'n':
+		messages = strtoul(optarg, NULL, 0);
+		break;
+	case 's':
+		size = strtoul(optarg, NULL, 0);
+		break;
+	case 'r':
+		num = strtoul(optarg, NULL, 0);
+		break;
+	case 'd':
+		depth = strtoul(optarg, NULL, 0);
+		break;
+	case 'g':
+		segs = strtoul(optarg, NULL, 0);
+		break;
+	case 'i':
+		indirect = 1;
+		break;
+	case 'k':
+		sim.packed = 1;
+		break;
+	case 'm':
+		sim.config.mode = strtoul(optarg, NULL, 0);
+		break;
+	case 'p':
+		sim.config.mode = FW_MODE_HYBRID;
+		sim.config.poll_budget = strtoul(optarg, NULL, 0);
+		break;
+	case 'c':
+		cycle = strtoul(optarg, NULL, 0);
+		break;
+	case 'l':
+		sim.config.trace_level = strtoul(optarg, NULL, 0);
+		break;
+	case 'M':
+		multiport = 1;
+		break;
+	case 'R':
+		sim.rpmsg = 1;
+		break;
+	case 'b':
+		sim.rpmsg = 1;
+		sim.bulk = 1;
+		break;
+	case 'e':
+		event_idx = 0;
+		break;
+	case 't':
+		trace_file = optarg;
+		break;
+	default:
+		print_usage_exit(argv[0]);
+	}
+
+	if (!num || (num & (num - 1)) || num > 32768 || !size || !segs ||
+	    sim.config.mode > FW_MODE_HYBRID)
+		print_usage_exit(argv[0]);
+
+	/*
+	 * rpmsg messages are single buffers, returned by head. Bulk messages
+	 * are in slots, so only their descriptors need fit.
+	 */
+	if (sim.rpmsg && (segs > 1 || indirect || sim.packed || multiport ||
+			  (!sim.bulk && size > RPMSG_BUF_SIZE - sizeof(struct rpmsg_hdr))))
+		print_usage_exit(argv[0]);
+
+	/* Descriptors each message takes from the ring */
+	msg_descs = indirect ? 1 : segs;
+	if (msg_descs > num)
+		print_usage_exit(argv[0]);
+	if (!depth || depth > num / msg_descs)
+		depth = num / msg_descs;
+
+	/*
+	 * The firmware offers VIRTIO_RING_F_EVENT_IDX and
+	 * VIRTIO_RING_F_INDIRECT_DESC in its dfeatures
+	 */
+	if (event_idx)
+		sim.gfeatures |= 1 << VIRTIO_RING_F_EVENT_IDX;
+	if (indirect)
+		sim.gfeatures |= 1 << VIRTIO_RING_F_INDIRECT_DESC;
+
+	/* Buffers are whole pages, as virtio_console allocates them */
+	buf_size = (size + 0xfff) & ~0xfff;
+
+	/*
+	 * Linux hands the firmware 32 bit device addresses, so keep the
+	 * simulated shared memory within the low 4GB.
+	 */
+	ring_size = (host_vq_size(num) + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1);
+	ctrl_ring_size = (host_vq_size(CTRL_NUM) + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1);
+	len = 2 * ring_size + 2 * (size_t)num * buf_size;
+	if (multiport)
+		len += 2 * ctrl_ring_size + 2 * CTRL_NUM * CTRL_BUF_SIZE;
+	mem = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS
+#ifdef MAP_32BIT
+		   | MAP_32BIT
+#endif
+		   , -1, 0);
+	if (mem == MAP_FAILED || (uint64_t)(uintptr_t)mem + len > 0x100000000ULL) {
+		perror("Couldn't allocate shared memory below 4GB");
+		return -1;
+	}
+
+	if (sim.bulk) {
+		/*
+		 * A slot, a whole number of cache lines, for each message in
+		 * flight. The carveout is a memfd, so that it can be mapped
+		 * again from its path, as user space maps it from /dev/mem.
+		 */
+		sim.bulk_slot_size = (size + 63) & ~63;
+		bulk_len = BULK_SLOT_OFFSET + (size_t)depth * sim.bulk_slot_size;
+		bulk_fd = memfd_create("bulk", 0);
+		if (bulk_fd < 0 || ftruncate(bulk_fd, bulk_len)) {
+			perror("Couldn't create bulk carveout");
+			return -1;
+		}
+		bulk_mem = mmap(NULL, bulk_len, PROT_READ | PROT_WRITE, MAP_SHARED
+#ifdef MAP_32BIT
+				| MAP_32BIT
+#endif
+				, bulk_fd, 0);
+		if (bulk_mem == MAP_FAILED ||
+		    (uint64_t)(uintptr_t)bulk_mem + bulk_len > 0x100000000ULL) {
+			perror("Couldn't map bulk carveout below 4GB");
+			return -1;
+		}
+
+		/* As Linux fills in a carveout asking for FW_RSC_ADDR_ANY */
+		sim.bulk_rsc.da = (uintptr_t)bulk_mem;
+		sim.bulk_rsc.pa = (uintptr_t)bulk_mem;
+		sim.bulk_rsc.len = bulk_len;
+	}
+
+	/* vring[0] is firmware -> host, vring[1] host -> firmware */
+	host_vq_init(&rx, mem, num, mem + 2 * ring_size, buf_size);
+	host_vq_init(&tx, mem + ring_size, num, mem + 2 * ring_size + num * buf_size, buf_size);
+
+	/* vring[2] is control firmware -> host, vring[3] host -> firmware */
+	if (multiport) {
+		uint8_t *ctrl = mem + 2 * ring_size + 2 * (size_t)num * buf_size;
+
+		host_vq_init(&ctrl_rx, ctrl, CTRL_NUM, ctrl + 2 * ctrl_ring_size, CTRL_BUF_SIZE);
+		host_vq_init(&ctrl_tx, ctrl + ctrl_ring_size, CTRL_NUM,
+			     ctrl + 2 * ctrl_ring_size + CTRL_NUM * CTRL_BUF_SIZE, CTRL_BUF_SIZE);
+	}
+
+	if (indirect) {
+		tx.indirect_size = segs * sizeof(struct vring_desc) + size + segs;
+		tx.indirect = calloc(num, tx.indirect_size);
+	}
+
+	/*
+	 * As Linux leaves the vdev the messages go over once its driver has
+	 * probed: port 0 of the serial vdev, with the control vrings if
+	 * multiport was negotiated, or the rpmsg bus. The vrings of the other
+	 * vdev are left unused.
+	 */
+	if (sim.rpmsg) {
+		vdev = &sim.rpmsg_rsc.vdev;
+		vrings = sim.rpmsg_rsc.vring;
+		vdev->id = VIRTIO_ID_RPMSG;
+		vdev->gfeatures = sim.gfeatures | 1 << VIRTIO_RPMSG_F_NS;
+		vdev->num_of_vrings = 2;
+	} else {
+		vdev = &sim.serial_rsc.vdev;
+		vrings = sim.serial_rsc.vring;
+		vdev->id = VIRTIO_ID_RPROC_SERIAL;
+		vdev->gfeatures = sim.gfeatures;
+		vdev->num_of_vrings = 2;
+		if (multiport) {
+			vdev->gfeatures |= 1 << VIRTIO_CONSOLE_F_MULTIPORT;
+			vdev->num_of_vrings = CONSOLE_NUM_VRINGS(NUM_PORTS);
+			vrings[2].da = (uintptr_t)(ctrl_rx.packed ? (void *)ctrl_rx.packed_desc :
+								   (void *)ctrl_rx.desc);
+			vrings[2].align = VRING_ALIGN;
+			vrings[2].num = CTRL_NUM;
+			vrings[2].notifyid = 3;
+			vrings[3].da = (uintptr_t)(ctrl_tx.packed ? (void *)ctrl_tx.packed_desc :
+								   (void *)ctrl_tx.desc);
+			vrings[3].align = VRING_ALIGN;
+			vrings[3].num = CTRL_NUM;
+			vrings[3].notifyid = 2;
+		}
+	}
+
+	vrings[0].da = (uintptr_t)(rx.packed ? (void *)rx.packed_desc : (void *)rx.desc);
+	vrings[0].align = VRING_ALIGN;
+	vrings[0].num = num;
+	vrings[0].notifyid = 1;
+	vrings[1].da = (uintptr_t)(tx.packed ? (void *)tx.packed_desc : (void *)tx.desc);
+	vrings[1].align = VRING_ALIGN;
+	vrings[1].num = num;
+	vrings[1].notifyid = 0;
+	vdev->status = VIRTIO_CONFIG_S_DRIVER_OK;
+
+	/* Give the firmware every receive buffer up front */
+	for (i = 0; i < num; i++) {
+		host_vq_set_desc(&rx, i, buf_size, VRING_DESC_F_WRITE, 0);
+		host_vq_add(&rx, i);
+	}
+	host_vq_publish(&rx);
+	host_vq_enable_cb(&rx);
+	host_vq_enable_cb(&tx);
+
+	/* And every control receive buffer */
+	if (multiport) {
+		for (i = 0; i < CTRL_NUM; i++) {
+			host_vq_set_desc(&ctrl_rx, i, CTRL_BUF_SIZE, VRING_DESC_F_WRITE, 0);
+			host_vq_add(&ctrl_rx, i);
+		}
+		host_vq_publish(&ctrl_rx);
+		host_vq_enable_cb(&ctrl_rx);
+		host_vq_enable_cb(&ctrl_tx);
+	}
+
+	/* Linux kicks the rpmsg receive vring once it has filled it */
+	if (sim.rpmsg)
+		kick_firmware();
+
+	if (pthread_create(&firmware, NULL, sim_firmware_main, NULL)) {
+		perror("Couldn't start firmware thread");
+		return -1;
+	}
+
+	/* Map the carveout once the firmware has written its header */
+	if (sim.bulk) {
+		snprintf(bulk_path, sizeof(bulk_path), "/proc/self/fd/%d", bulk_fd);
+		progress = now_ns();
+		while (bulk_map_open(&bulk_map, bulk_path, 0)) {
+			if (errno != ENODEV || now_ns() - progress > STALL_TIMEOUT_NS) {
+				perror("Couldn't map bulk carveout");
+				ret = 1;
+				goto out;
+			}
+			sched_yield();
+		}
+	}
+
+	if (multiport && console_setup(&ctrl_rx, &ctrl_tx)) {
+		ret = 1;
+		goto out;
+	}
+
+	start = progress = now_ns();
+	while (received < messages) {
+		int idle = 1;
+
+		/* Reclaim buffers the firmware has consumed */
+		while (host_vq_get_used(&tx, &id, &used_len))
+			host_vq_free_chain(&tx, id);
+		host_vq_enable_cb(&tx);
+
+		/* Check and recycle responses */
+		while (host_vq_get_used(&rx, &id, &used_len)) {
+			uint8_t *buf = host_vq_buf(&rx, id);
+			int n = sim.rpmsg ? rpmsg_unwrap(&buf, &used_len, &announced) : 1;
+
+			if (n == 0) {
+				/* An endpoint announcement, once each */
+				host_vq_add(&rx, id);
+				idle = 0;
+				continue;
+			}
+			if (n > 0 && sim.bulk)
+				n = bulk_unwrap(&buf, &used_len);
+			if (n < 1 || used_len != size ||
+			    !check_response(buf, used_len, received)) {
+				fprintf(stderr, "Bad response to message %lu\n", received);
+				ret = 1;
+				goto out;
+			}
+			received++;
+			host_vq_add(&rx, id);
+			idle = 0;
+
+			/* The firmware picks the new mode up on its next kick */
+			if (cycle && received % cycle == 0)
+				sim.config.mode = (sim.config.mode + 1) % (FW_MODE_HYBRID + 1);
+		}
+		host_vq_enable_cb(&rx);
+		if (!idle && host_vq_publish(&rx))
+			kick_firmware();
+
+		/* Send as many new messages as the depth allows */
+		if (sent < messages && sent - received < depth && tx.num_free >= msg_descs) {
+			do {
+				send_message(&tx, size, segs, sent);
+				sent++;
+			} while (sent < messages && sent - received < depth && tx.num_free >= msg_descs);
+
+			if (host_vq_publish(&tx))
+				kick_firmware();
+			idle = 0;
+		}
+
+		if (idle) {
+			if (now_ns() - progress > STALL_TIMEOUT_NS) {
+				fprintf(stderr, "Firmware stalled after %lu messages\n", received);
+				ret = 1;
+				goto out;
+			}
+			sched_yield();
+		} else {
+			progress = now_ns();
+		}
+	}
+	elapsed = now_ns() - start;
+	secs = elapsed / 1e9;
+
+	if (sim.rpmsg && announced != (1 << sizeof(rpmsg_names) / sizeof(rpmsg_names[0])) - 1) {
+		fprintf(stderr, "rpmsg endpoints were never announced\n");
+		ret = 1;
+		goto out;
+	}
+
+	printf("%s ring %u, size %u in %u %ssegs, depth %u%s%s%s%s: %lu messages in %.3f s\n",
+	       sim.packed ? "packed" : "split", num, size, segs, indirect ? "indirect " : "", depth,
+	       event_idx ? ", event idx" : "", multiport ? ", multiport" : "",
+	       sim.rpmsg ? ", rpmsg" : "", sim.bulk ? ", bulk" : "", received, secs);
+	printf("  %.0f messages/s, %.0f ns/message, %.0f ns/buffer\n",
+	       received / secs, (double)elapsed / received,
+	       (double)elapsed / (2 * received));
+	printf("  %.2f kicks/message, %.2f irqs/message\n",
+	       (double)sim.kicks / received, (double)sim.irqs / received);
+	if (poll_switches)
+		printf("  %u switches to polling, budget %u ns\n",
+		       poll_switches, sim.config.poll_budget);
+	if (cycle)
+		printf("  %u changes of mode\n", mode_switches);
+
+out:
+	__atomic_store_n(&sim.stop, 1, __ATOMIC_SEQ_CST);
+	kick_firmware();
+	pthread_join(firmware, NULL);
+
+	if (trace_file) {
+		/* As Linux reads it, up to the first NUL */
+		size_t trace_len = strnlen(trace_buf, TRACE_BUFFER_SIZE);
+		FILE *f = fopen(trace_file, "wb");
+
+		if (!f || fwrite(trace_buf, 1, trace_len, f) != trace_len)
+			perror(trace_file);
+		if (f)
+			fclose(f);
+	}
+
+	return ret;
+}